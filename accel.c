@@ -0,0 +1,127 @@
+// acceleration curves, see accel.h
+
+#include "accel.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PIECEWISE_POINTS 16
+
+enum AccelCurveType
+{
+    ACCEL_POWER,
+    ACCEL_SIGMOID,
+    ACCEL_PIECEWISE
+};
+
+struct AccelParams {
+    enum AccelCurveType type;
+    double values[3]; // power: exponent, v0. sigmoid: max gain, midpoint, width
+    double point_velocities[MAX_PIECEWISE_POINTS];
+    double point_gains[MAX_PIECEWISE_POINTS];
+    int num_points;
+};
+
+static double evaluate(const struct AccelParams* params, double velocity)
+{
+    switch (params->type)
+    {
+    case ACCEL_POWER:
+        return velocity <= params->values[1] ? 1 : pow(velocity / params->values[1], params->values[0] - 1);
+    case ACCEL_SIGMOID:
+    {
+        // shifted so that standing still has a gain of 1
+        double at_rest = 1 / (1 + exp(params->values[1] / params->values[2]));
+        double s = 1 / (1 + exp(-(velocity - params->values[1]) / params->values[2]));
+        return 1 + (params->values[0] - 1) * (s - at_rest) / (1 - at_rest);
+    }
+    case ACCEL_PIECEWISE:
+    {
+        if (velocity <= params->point_velocities[0]) return params->point_gains[0];
+        for (int i = 1; i < params->num_points; i++)
+        {
+            if (velocity > params->point_velocities[i]) continue;
+            double v0 = params->point_velocities[i - 1];
+            double fraction = (velocity - v0) / (params->point_velocities[i] - v0);
+            return params->point_gains[i - 1] + fraction * (params->point_gains[i] - params->point_gains[i - 1]);
+        }
+        return params->point_gains[params->num_points - 1];
+    }
+    }
+    return 1;
+}
+
+// up to max numbers separated by ':', returns how many, -1 if one isn't a number
+static int parse_numbers(const char* s, double* values, int max)
+{
+    int n = 0;
+    while (*s != '\0' && n < max)
+    {
+        char* end;
+        values[n++] = strtod(s, &end);
+        if (end == s || (*end != ':' && *end != '\0')) return -1;
+        s = *end == ':' ? end + 1 : end;
+    }
+    return *s == '\0' ? n : -1;
+}
+
+static int parse_points(const char* s, struct AccelParams* params)
+{
+    while (*s != '\0' && params->num_points < MAX_PIECEWISE_POINTS)
+    {
+        char* end;
+        double velocity = strtod(s, &end);
+        if (end == s || *end != '=') return -1;
+        s = end + 1;
+        double gain = strtod(s, &end);
+        if (end == s || (*end != ',' && *end != '\0') || gain <= 0) return -1;
+        if (params->num_points > 0 && velocity <= params->point_velocities[params->num_points - 1]) return -1; // ascending
+        params->point_velocities[params->num_points] = velocity;
+        params->point_gains[params->num_points++] = gain;
+        s = *end == ',' ? end + 1 : end;
+    }
+    return *s == '\0' && params->num_points > 0 ? 0 : -1;
+}
+
+int accel_curve_parse(struct AccelCurve* curve, const char* spec)
+{
+    struct AccelParams params;
+    memset(&params, 0, sizeof(params));
+    if (strncmp(spec, "power:", 6) == 0)
+    {
+        params.type = ACCEL_POWER;
+        params.values[1] = 1;
+        int n = parse_numbers(spec + 6, params.values, 2);
+        if (n < 1 || params.values[0] < 1 || params.values[1] <= 0) return -1;
+    }
+    else if (strncmp(spec, "sigmoid:", 8) == 0)
+    {
+        params.type = ACCEL_SIGMOID;
+        int n = parse_numbers(spec + 8, params.values, 3);
+        if (n < 2 || params.values[0] < 1 || params.values[1] <= 0) return -1;
+        if (n == 2)
+            params.values[2] = params.values[1] / 4;
+        if (params.values[2] <= 0) return -1;
+    }
+    else if (strncmp(spec, "piecewise:", 10) == 0)
+    {
+        params.type = ACCEL_PIECEWISE;
+        if (parse_points(spec + 10, &params) != 0) return -1;
+    }
+    else
+    {
+        return -1;
+    }
+
+    // each entry holds the gain at its velocity, the lookup interpolates between them. The inverse of accel_log2
+    curve->entries_per_octave = (ACCEL_TABLE_SIZE - 1) / log2(ACCEL_MAX_VELOCITY / ACCEL_MIN_VELOCITY);
+    for (int i = 0; i < ACCEL_TABLE_SIZE; i++)
+    {
+        double octaves = i / curve->entries_per_octave;
+        double octave = floor(octaves);
+        double velocity = fmin(ACCEL_MIN_VELOCITY * exp2(octave) * (1 + octaves - octave), ACCEL_MAX_VELOCITY);
+        curve->gains[i] = (float) evaluate(&params, velocity);
+    }
+    return 0;
+}
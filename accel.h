@@ -0,0 +1,44 @@
+// velocity dependent acceleration of the movement before it is scrolled: slow movement scrolls as with the plain
+// threshold, fast movement scrolls further per count. The curve is evaluated into a table once, a motion
+// event costs a division, a frexp and an interpolation between two entries whatever the curve. There are as many
+// entries per doubling of the velocity at any speed, as densely for a slow trackball as for a fast flick.
+// curves, velocity in counts per ms (of -c, or of the -m scale), gain a factor on the movement:
+//   power:<exponent>[:<v0>]             gain (v / v0)^(exponent - 1) above v0 (default 1), 1 below it
+//   sigmoid:<max gain>:<midpoint>[:<width>]   from 1 to max gain around the midpoint, width default midpoint / 4
+//   piecewise:<v>=<gain>,<v>=<gain>,...  interpolated between the points, flat beyond the first and the last
+
+#ifndef ACCEL_H
+#define ACCEL_H
+
+#include <math.h>
+
+#define ACCEL_TABLE_SIZE 256
+#define ACCEL_MIN_VELOCITY (1 / 64.0) // counts per ms, the table's first entry. Slower movement gets its gain
+#define ACCEL_MAX_VELOCITY 64.0 // the table's last entry. Faster movement gets its gain
+
+struct AccelCurve {
+    float gains[ACCEL_TABLE_SIZE];
+    double entries_per_octave; // table index of a velocity is accel_log2(velocity / ACCEL_MIN_VELOCITY) * this
+};
+
+// log2 of x >= 1, exact at powers of two and linear between them: the exponent plus the fraction of the octave
+static inline double accel_log2(double x)
+{
+    int exponent;
+    double mantissa = frexp(x, &exponent); // 0.5 <= mantissa < 1
+    return exponent - 2 + 2 * mantissa;
+}
+
+// fills the table from the description. Returns 0, -1 if it is malformed
+int accel_curve_parse(struct AccelCurve* curve, const char* spec);
+
+static inline double accel_curve_gain(const struct AccelCurve* curve, double velocity)
+{
+    if (velocity <= ACCEL_MIN_VELOCITY) return curve->gains[0];
+    double index = accel_log2(velocity / ACCEL_MIN_VELOCITY) * curve->entries_per_octave;
+    if (index >= ACCEL_TABLE_SIZE - 1) return curve->gains[ACCEL_TABLE_SIZE - 1];
+    int i = (int) index;
+    return curve->gains[i] + (index - i) * (curve->gains[i + 1] - curve->gains[i]);
+}
+
+#endif // ACCEL_H
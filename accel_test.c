@@ -0,0 +1,64 @@
+// the gain looked up in the table against the curve itself, over the whole range of velocities and especially
+// at the slow end, where a trackball rolled gently moves a fraction of a count per ms
+
+#include "accel.h"
+#include "test.h"
+
+static const double MAX_RELATIVE_ERROR = 0.005;
+
+// velocities spaced evenly in log2, from slower than the table to faster
+static void check_curve(const char* spec, double (*expected_gain)(double velocity))
+{
+    struct AccelCurve curve;
+    CHECK(accel_curve_parse(&curve, spec) == 0);
+    for (double velocity = ACCEL_MIN_VELOCITY / 4; velocity < ACCEL_MAX_VELOCITY * 4; velocity *= 1.01)
+    {
+        double expected = expected_gain(fmax(fmin(velocity, ACCEL_MAX_VELOCITY), ACCEL_MIN_VELOCITY));
+        double gain = accel_curve_gain(&curve, velocity);
+        if (fabs(gain - expected) > MAX_RELATIVE_ERROR * expected)
+        {
+            fprintf(stderr, "%s at %g counts/ms: gain %g, expected %g\n", spec, velocity, gain, expected);
+            test_failures++;
+            return;
+        }
+    }
+}
+
+static double power_gain(double velocity)
+{
+    return velocity <= 0.1 ? 1 : pow(velocity / 0.1, 1.5 - 1);
+}
+
+static double sigmoid_gain(double velocity)
+{
+    double at_rest = 1 / (1 + exp(0.5 / 0.125));
+    double s = 1 / (1 + exp(-(velocity - 0.5) / 0.125));
+    return 1 + (3 - 1) * (s - at_rest) / (1 - at_rest);
+}
+
+static double piecewise_gain(double velocity)
+{
+    if (velocity <= 0.05) return 1;
+    if (velocity <= 0.2) return 1 + (velocity - 0.05) / 0.15;
+    if (velocity <= 20) return 2 + (velocity - 0.2) / 19.8 * 2;
+    return 4;
+}
+
+static void test_parse_errors()
+{
+    struct AccelCurve curve;
+    CHECK(accel_curve_parse(&curve, "power:0.5") == -1);
+    CHECK(accel_curve_parse(&curve, "sigmoid:2") == -1);
+    CHECK(accel_curve_parse(&curve, "piecewise:1=1,0.5=2") == -1);
+    CHECK(accel_curve_parse(&curve, "piecewise:") == -1);
+    CHECK(accel_curve_parse(&curve, "linear") == -1);
+}
+
+int main()
+{
+    check_curve("power:1.5:0.1", power_gain);
+    check_curve("sigmoid:3:0.5", sigmoid_gain);
+    check_curve("piecewise:0.05=1,0.2=2,20=4", piecewise_gain);
+    test_parse_errors();
+    return TEST_RESULT();
+}
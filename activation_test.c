@@ -0,0 +1,85 @@
+// activation by the trigger key must not wait for the X server: checked with the round trip counters of the
+// event loop's connection around handle_key_press. Needs an X server (e.g. Xvfb), skipped without one.
+// the event loop is static in main.c, so it is compiled in here.
+
+#define main mouse_move_to_scroll_main
+#include "main.c"
+#undef main
+
+#include "test.h"
+
+#define SKIPPED 77
+#define TRIGGER_KEY_CODE 37
+
+static struct XTraffic activate(struct EventLoop* loop, EventTime time)
+{
+    struct XTraffic before = get_x_traffic(loop->display);
+    handle_key_press(loop, TRIGGER_KEY_CODE, 0, False, time);
+    return subtract_x_traffic(get_x_traffic(loop->display), before);
+}
+
+static struct XTraffic deactivate(struct EventLoop* loop, EventTime time)
+{
+    struct XTraffic before = get_x_traffic(loop->display);
+    handle_key_release(loop, TRIGGER_KEY_CODE, time);
+    return subtract_x_traffic(get_x_traffic(loop->display), before);
+}
+
+static void test_activation(Display* display, enum PointerFixation pointer_fixation)
+{
+    static struct Config cfg;
+    cfg = create_default_config();
+    cfg.trigger_key_code = TRIGGER_KEY_CODE;
+    cfg.pointer_fixation = pointer_fixation;
+
+    struct EventLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.cfg = &cfg;
+    loop.display = display;
+    loop.window = DefaultRootWindow(display);
+
+    // the startup of main(), it may wait for the server
+    loop.xi_opcode = ensure_xinput2_or_exit(display);
+    ensure_pointer_fixation_supported(display, &cfg);
+    load_input_devices(&input_devices, display);
+    resolve_pointer_devices(&cfg);
+    request_to_receive_events(display, loop.window, False);
+    struct ScrollSink sink = { .scroll = trigger_scroll, .release_key = release_key, .data = NULL };
+    struct ScrollClock clock = { .now = scroll_clock_now, .data = &loop };
+    init_scroll_core(&loop, False, sink, clock);
+    XSync(display, False);
+
+    // the key event tells where the pointer is
+    track_pointer_position(&loop, 100, 100);
+    EventTime time = 1000;
+    for (int n = 0; n < 3; n++, time += 100)
+    {
+        struct XTraffic traffic = activate(&loop, time);
+        CHECK(scroll_core.is_active);
+        CHECK(traffic.round_trips == 0);
+        if (traffic.round_trips != 0)
+            fprintf(stderr, "activation %d with fixation %d: %lu requests, %lu round trips\n", n, pointer_fixation, traffic.requests, traffic.round_trips);
+
+        traffic = deactivate(&loop, time + 50);
+        CHECK(!scroll_core.is_active);
+        CHECK(traffic.round_trips == 0);
+    }
+    XSync(display, False);
+}
+
+int main()
+{
+    log_level = LOG_WARN;
+    Display* display = XOpenDisplay(NULL);
+    if (display == NULL)
+    {
+        printf("no X server, skipped\n");
+        return SKIPPED;
+    }
+    watch_x_traffic(display);
+
+    test_activation(display, FIXATE_BY_BARRIERS);
+    test_activation(display, FIXATE_BY_WARPING);
+    XCloseDisplay(display);
+    return TEST_RESULT();
+}
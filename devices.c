@@ -0,0 +1,164 @@
+// XInput2 device table, see devices.h
+
+#include "devices.h"
+
+#include <string.h>
+#include <strings.h>
+#include "log.h"
+
+// valuators with less than a count per mm didn't set a resolution (0 or 1 per metre)
+#define MIN_COUNTS_PER_M 1000
+
+static void set_input_device_axes(struct InputDevice* device, const XIDeviceInfo* info)
+{
+    device->counts_per_mm[0] = 0;
+    device->counts_per_mm[1] = 0;
+    for (int i = 0; i < info->num_classes; i++)
+    {
+        if (info->classes[i]->type != XIValuatorClass) continue;
+        const XIValuatorClassInfo* valuator = (const XIValuatorClassInfo*) info->classes[i];
+        if (valuator->number > 1 || valuator->resolution < MIN_COUNTS_PER_M) continue;
+        device->counts_per_mm[valuator->number] = valuator->resolution / 1000.0;
+    }
+    if (device->counts_per_mm[0] > 0 || device->counts_per_mm[1] > 0)
+    {
+        logg(LOG_DEBUG, "input device %d '%s' has %g x %g counts per mm\n", device->id, device->name,
+             device->counts_per_mm[0], device->counts_per_mm[1]);
+    }
+}
+
+static struct InputDevice* add_input_device(struct DeviceTable* table, const XIDeviceInfo* info)
+{
+    if (table->num_devices == MAX_INPUT_DEVICES)
+    {
+        logg(LOG_WARN, "too many input devices, ignoring %d '%s'\n", info->deviceid, info->name);
+        return NULL;
+    }
+    struct InputDevice* device = &table->devices[table->num_devices++];
+    memset(device, 0, sizeof(*device));
+    device->id = info->deviceid;
+    device->use = info->use;
+    device->attachment = info->attachment;
+    device->is_enabled = info->enabled;
+    strncpy(device->name, info->name, sizeof(device->name) - 1);
+    logg(LOG_DEBUG, "input device %d '%s' use %d attached to %d\n", device->id, device->name, device->use, device->attachment);
+    set_input_device_axes(device, info);
+    return device;
+}
+
+static void retire_input_device_stats(struct DeviceTable* table, const struct InputDevice* device)
+{
+    table->retired_stats.scrolls += device->core.stats.scrolls;
+    table->retired_stats.rate_limited_decisions += device->core.stats.rate_limited_decisions;
+    table->retired_stats.discarded_backlog_clicks += device->core.stats.discarded_backlog_clicks;
+}
+
+static void remove_input_device(struct DeviceTable* table, struct InputDevice* device)
+{
+    logg(LOG_DEBUG, "input device %d '%s' removed\n", device->id, device->name);
+    retire_input_device_stats(table, device);
+    // keep the order, masters come before their slaves
+    int index = (int) (device - table->devices);
+    memmove(device, device + 1, (size_t) (table->num_devices - index - 1) * sizeof(*device));
+    table->num_devices--;
+}
+
+void load_input_devices(struct DeviceTable* table, Display* display)
+{
+    for (int i = 0; i < table->num_devices; i++)
+        retire_input_device_stats(table, &table->devices[i]);
+    table->num_devices = 0;
+    int num_devices = 0;
+    XIDeviceInfo* devices = XIQueryDevice(display, XIAllDevices, &num_devices);
+    for (int i = 0; i < num_devices; i++)
+        add_input_device(table, &devices[i]);
+    if (devices != NULL)
+        XIFreeDeviceInfo(devices);
+}
+
+struct InputDevice* find_input_device(struct DeviceTable* table, int id)
+{
+    for (int i = 0; i < table->num_devices; i++)
+    {
+        if (table->devices[i].id == id)
+            return &table->devices[i];
+    }
+    return NULL;
+}
+
+struct InputDevice* find_input_device_by_name(struct DeviceTable* table, const char* name)
+{
+    for (int i = 0; i < table->num_devices; i++)
+    {
+        if (strcasecmp(table->devices[i].name, name) == 0)
+            return &table->devices[i];
+    }
+    return NULL;
+}
+
+struct InputDevice* update_input_device(struct DeviceTable* table, Display* display, int id, int flags, int attachment, Bool is_enabled)
+{
+    struct InputDevice* device = find_input_device(table, id);
+    if (flags & (XISlaveRemoved | XIMasterRemoved))
+    {
+        if (device != NULL)
+            remove_input_device(table, device);
+        return NULL;
+    }
+
+    if (device == NULL)
+    {
+        if (!(flags & (XISlaveAdded | XIMasterAdded | XIDeviceEnabled)))
+            return NULL;
+
+        // only the new device is queried, not all of them
+        int num_devices = 0;
+        XIDeviceInfo* info = XIQueryDevice(display, id, &num_devices);
+        struct InputDevice* added = num_devices == 1 ? add_input_device(table, info) : NULL;
+        if (info != NULL)
+            XIFreeDeviceInfo(info);
+        return added;
+    }
+
+    if (flags & (XISlaveAttached | XISlaveDetached))
+        device->attachment = attachment;
+    if (flags & (XIDeviceEnabled | XIDeviceDisabled))
+        device->is_enabled = is_enabled;
+    return NULL;
+}
+
+struct InputDevice* set_recorded_input_device(struct DeviceTable* table, int id, const char* name, const double counts_per_mm[2])
+{
+    struct InputDevice* device = find_input_device(table, id);
+    if (device == NULL)
+    {
+        if (table->num_devices == MAX_INPUT_DEVICES)
+        {
+            logg(LOG_WARN, "too many input devices, ignoring %d '%s'\n", id, name);
+            return NULL;
+        }
+        device = &table->devices[table->num_devices++];
+        memset(device, 0, sizeof(*device));
+        device->id = id;
+        device->use = XISlavePointer;
+        device->is_enabled = True;
+    }
+    strncpy(device->name, name, sizeof(device->name) - 1);
+    device->counts_per_mm[0] = counts_per_mm[0];
+    device->counts_per_mm[1] = counts_per_mm[1];
+    return device;
+}
+
+struct InputDevice* reload_input_device_axes(struct DeviceTable* table, Display* display, int id)
+{
+    struct InputDevice* device = find_input_device(table, id);
+    if (device == NULL) return NULL;
+
+    int num_devices = 0;
+    XIDeviceInfo* info = XIQueryDevice(display, id, &num_devices);
+    if (num_devices == 1)
+        set_input_device_axes(device, info);
+    if (info != NULL)
+        XIFreeDeviceInfo(info);
+    return device;
+}
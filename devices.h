@@ -0,0 +1,56 @@
+// the XInput2 devices, kept up to date from XI_HierarchyChanged and XI_DeviceChanged events. The table is
+// filled with one XIQueryDevice at startup, after that only a device that appears is queried (by its id).
+// every pointer has its own scroll core: movement of two pointers moving at once doesn't mix, and a device
+// can have its own threshold and options. The resolution of its x and y valuators is kept as well, so its
+// movement can be measured in millimetres.
+
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#include "scrollcore.h"
+
+#define MAX_INPUT_DEVICES 64
+#define MAX_DEVICE_NAME_LEN 128
+
+struct InputDevice {
+    int id;
+    int use; // XIMasterPointer, XISlavePointer, XIFloatingSlave, XIMasterKeyboard, ...
+    int attachment; // master of a slave, paired device of a master
+    Bool is_enabled;
+    char name[MAX_DEVICE_NAME_LEN];
+    Bool is_selected; // its raw motion is selected for individually (named with -p)
+    double counts_per_mm[2]; // of valuator 0 (x) and 1 (y), 0 if the device doesn't report a resolution
+    double motion_scale[2]; // raw counts to the units of the threshold, set up by the caller with the core
+    Bool is_recorded; // with --record: its resolution and name are in the trace
+    struct ScrollCore core; // pointers only, set up by the caller
+};
+
+struct DeviceTable {
+    struct InputDevice devices[MAX_INPUT_DEVICES];
+    int num_devices;
+    struct ScrollCoreStats retired_stats; // of the cores of devices no longer in the table, so the totals never go back
+};
+
+static inline Bool is_pointer_device(const struct InputDevice* device)
+{
+    return device->use == XIMasterPointer || device->use == XISlavePointer || device->use == XIFloatingSlave;
+}
+
+// replaces the table with all devices, one round trip. The stats of the old devices' cores are retired
+void load_input_devices(struct DeviceTable* table, Display* display);
+struct InputDevice* find_input_device(struct DeviceTable* table, int id);
+// case insensitive, the first match
+struct InputDevice* find_input_device_by_name(struct DeviceTable* table, const char* name);
+
+// applies one device's part of a hierarchy change (XIHierarchyInfo). Queries the device if it is new to the table.
+// returns the device if it was added, NULL otherwise
+struct InputDevice* update_input_device(struct DeviceTable* table, Display* display, int id, int flags, int attachment, Bool is_enabled);
+// a slave pointer of a replayed trace, with the resolution and name it had when recorded. Updates the device if the
+// table has it already. Returns the device, NULL if the table is full
+struct InputDevice* set_recorded_input_device(struct DeviceTable* table, int id, const char* name, const double counts_per_mm[2]);
+// queries the device's valuators again after an XI_DeviceChanged. Returns the device, NULL if it isn't in the table
+struct InputDevice* reload_input_device_axes(struct DeviceTable* table, Display* display, int id);
+
+#endif // DEVICES_H
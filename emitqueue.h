@@ -0,0 +1,76 @@
+// single producer (event loop), single consumer (emitter thread) ring buffer of output commands.
+// head and tail only grow, their difference is the fill level. They live on separate cache lines.
+// the producer queues commands and publishes them together, the consumer only sees published ones. Waking the
+// consumer up is left to the caller (an eventfd in the program).
+
+#ifndef EMITQUEUE_H
+#define EMITQUEUE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "scrollcore.h"
+
+#define EMIT_QUEUE_CAPACITY 256 // power of two
+
+enum EmitCommandType
+{
+    EMIT_SCROLL,
+    EMIT_KEY_RELEASE
+};
+
+// output for the emitter thread: scrolling along one axis, or a key released
+struct EmitCommand {
+    enum EmitCommandType type;
+    enum ScrollDirection direction;
+    double clicks; // < 0: up/left. Whole clicks unless the output has high resolution
+    unsigned int key_code;
+    int64_t decided_ns; // CLOCK_MONOTONIC when the scroll was decided on, 0: not measured
+};
+
+struct EmitQueue {
+    _Atomic unsigned long head __attribute__((aligned(64))); // next command to send, advanced by the consumer
+    _Atomic unsigned long tail __attribute__((aligned(64))); // end of the published commands, advanced by the producer
+    unsigned long unpublished_tail __attribute__((aligned(64))); // producer only, queued up to here
+    struct EmitCommand commands[EMIT_QUEUE_CAPACITY] __attribute__((aligned(64)));
+};
+
+// by the producer, visible to the consumer after the next emit_queue_publish(). reserved_slots are left free.
+// returns the fill level including the command, 0 if the queue is too full and the command wasn't queued
+static inline unsigned long emit_queue_push(struct EmitQueue* queue, const struct EmitCommand* cmd, unsigned long reserved_slots)
+{
+    unsigned long tail = queue->unpublished_tail;
+    unsigned long head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head >= EMIT_QUEUE_CAPACITY - reserved_slots)
+        return 0;
+
+    queue->commands[tail & (EMIT_QUEUE_CAPACITY - 1)] = *cmd;
+    queue->unpublished_tail = tail + 1;
+    return tail + 1 - head;
+}
+
+// by the producer, hands the queued commands to the consumer as one batch. Returns 1 if there were any
+static inline int emit_queue_publish(struct EmitQueue* queue)
+{
+    if (atomic_load_explicit(&queue->tail, memory_order_relaxed) == queue->unpublished_tail) return 0;
+    atomic_store_explicit(&queue->tail, queue->unpublished_tail, memory_order_release);
+    return 1;
+}
+
+// by the consumer: how many published commands wait. Each is read with emit_queue_front(), then emit_queue_pop()
+// gives its slot back
+static inline unsigned long emit_queue_published(struct EmitQueue* queue)
+{
+    return atomic_load_explicit(&queue->tail, memory_order_acquire) - atomic_load_explicit(&queue->head, memory_order_relaxed);
+}
+
+static inline struct EmitCommand* emit_queue_front(struct EmitQueue* queue)
+{
+    return &queue->commands[atomic_load_explicit(&queue->head, memory_order_relaxed) & (EMIT_QUEUE_CAPACITY - 1)];
+}
+
+static inline void emit_queue_pop(struct EmitQueue* queue)
+{
+    atomic_store_explicit(&queue->head, atomic_load_explicit(&queue->head, memory_order_relaxed) + 1, memory_order_release);
+}
+
+#endif // EMITQUEUE_H
@@ -0,0 +1,194 @@
+// measures the queue between the event loop and the emitter thread: what a push and a pop cost on one thread,
+// and the throughput with the consumer on its own thread, for different batch sizes (commands per publish).
+// the consumer polls here, yielding when the queue is empty, and the producer yields when it is full, so the run
+// also finishes on a single core.
+// then the wake-up as in the program: the consumer sleeps on an eventfd, the producer writes it once per published
+// batch. Shows the latency from publishing to the consumer running, and what the wake-ups cost per command.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "emitqueue.h"
+
+#define NUM_COMMANDS (1 << 22)
+#define NUM_WAKEUPS 20000
+
+static const int BATCH_SIZES[] = { 1, 2, 8, 32, 128 };
+
+static struct EmitQueue queue;
+
+static int64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void reset_queue()
+{
+    memset(&queue, 0, sizeof(queue));
+}
+
+// push and pop on the same thread, the cost without any sharing of cache lines
+static double run_single_thread()
+{
+    reset_queue();
+    struct EmitCommand cmd = { .type = EMIT_SCROLL, .direction = SCROLL_VERTICAL, .clicks = 1 };
+    double clicks = 0;
+    int64_t start_ns = monotonic_ns();
+    for (int i = 0; i < NUM_COMMANDS; i++)
+    {
+        emit_queue_push(&queue, &cmd, 0);
+        emit_queue_publish(&queue);
+        clicks += emit_queue_front(&queue)->clicks;
+        emit_queue_pop(&queue);
+    }
+    double ns = (double) (monotonic_ns() - start_ns) / NUM_COMMANDS;
+    if (clicks != NUM_COMMANDS)
+        fprintf(stderr, "lost commands\n");
+    return ns;
+}
+
+static void* consume(void* arg)
+{
+    unsigned long* received = (unsigned long*) arg;
+    while (*received < NUM_COMMANDS)
+    {
+        unsigned long published = emit_queue_published(&queue);
+        if (published == 0)
+            sched_yield();
+        for (unsigned long n = published; n > 0; n--)
+        {
+            (*received)++;
+            emit_queue_pop(&queue);
+        }
+    }
+    return NULL;
+}
+
+// the producer pushes batch_size commands, publishes them and retries when the queue is full.
+// returns the ns per command, full: how often the producer found the queue full
+static double run_two_threads(int batch_size, unsigned long* full)
+{
+    reset_queue();
+    unsigned long received = 0;
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, consume, &received);
+
+    struct EmitCommand cmd = { .type = EMIT_SCROLL, .direction = SCROLL_VERTICAL, .clicks = 1 };
+    *full = 0;
+    int64_t start_ns = monotonic_ns();
+    for (int sent = 0; sent < NUM_COMMANDS;)
+    {
+        for (int i = 0; i < batch_size && sent < NUM_COMMANDS; i++)
+        {
+            if (emit_queue_push(&queue, &cmd, 0) == 0)
+            {
+                (*full)++;
+                emit_queue_publish(&queue);
+                sched_yield();
+                break;
+            }
+            sent++;
+        }
+        emit_queue_publish(&queue);
+    }
+    pthread_join(consumer, NULL);
+    return (double) (monotonic_ns() - start_ns) / NUM_COMMANDS;
+}
+
+struct WakeupRun {
+    int fd;
+    int batch_size;
+    int64_t latencies_ns[NUM_WAKEUPS];
+};
+
+static void* consume_on_wakeup(void* arg)
+{
+    struct WakeupRun* run = (struct WakeupRun*) arg;
+    for (int wakeup = 0; wakeup < NUM_WAKEUPS;)
+    {
+        uint64_t kicks;
+        if (read(run->fd, &kicks, sizeof(kicks)) != sizeof(kicks)) continue;
+        int64_t woken_ns = monotonic_ns();
+        unsigned long published = emit_queue_published(&queue);
+        if (published == 0) continue;
+        run->latencies_ns[wakeup++] = woken_ns - emit_queue_front(&queue)->decided_ns;
+        for (unsigned long n = published; n > 0; n--)
+            emit_queue_pop(&queue);
+    }
+    return NULL;
+}
+
+static int compare_int64(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+// one batch per wake-up, published to an idle consumer as the event loop does once per drain.
+// returns the ns per command, the latencies are sorted in run
+static double run_wakeups(struct WakeupRun* run)
+{
+    reset_queue();
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, consume_on_wakeup, run);
+
+    struct EmitCommand cmd = { .type = EMIT_SCROLL, .direction = SCROLL_VERTICAL, .clicks = 1 };
+    int64_t start_ns = monotonic_ns();
+    for (int wakeup = 0; wakeup < NUM_WAKEUPS; wakeup++)
+    {
+        // wait for the consumer to finish the previous batch, so every wake-up finds it asleep
+        while (emit_queue_published(&queue) != 0)
+            sched_yield();
+        cmd.decided_ns = monotonic_ns();
+        for (int i = 0; i < run->batch_size; i++)
+            emit_queue_push(&queue, &cmd, 0);
+        emit_queue_publish(&queue);
+        uint64_t one = 1;
+        if (write(run->fd, &one, sizeof(one)) != sizeof(one))
+            perror("eventfd");
+    }
+    pthread_join(consumer, NULL);
+    double ns = (double) (monotonic_ns() - start_ns) / ((double) NUM_WAKEUPS * run->batch_size);
+    qsort(run->latencies_ns, NUM_WAKEUPS, sizeof(int64_t), compare_int64);
+    return ns;
+}
+
+int main()
+{
+    printf("%d commands per run, queue of %d\n", NUM_COMMANDS, EMIT_QUEUE_CAPACITY);
+    printf("single thread push, publish, pop: %.2f ns/command\n\n", run_single_thread());
+
+    printf("%10s %12s %14s %10s\n", "batch", "ns/command", "Mcommands/s", "full");
+    for (size_t b = 0; b < sizeof(BATCH_SIZES) / sizeof(BATCH_SIZES[0]); b++)
+    {
+        unsigned long full;
+        double ns = run_two_threads(BATCH_SIZES[b], &full);
+        printf("%10d %12.2f %14.1f %10lu\n", BATCH_SIZES[b], ns, 1000 / ns, full);
+    }
+
+    printf("\n%d eventfd wake-ups per run\n", NUM_WAKEUPS);
+    printf("%10s %12s %12s %12s %12s\n", "batch", "ns/command", "p50 us", "p99 us", "max us");
+    static struct WakeupRun run;
+    run.fd = eventfd(0, EFD_CLOEXEC);
+    if (run.fd == -1)
+    {
+        perror("eventfd");
+        return 1;
+    }
+    for (size_t b = 0; b < sizeof(BATCH_SIZES) / sizeof(BATCH_SIZES[0]); b++)
+    {
+        run.batch_size = BATCH_SIZES[b];
+        double ns = run_wakeups(&run);
+        printf("%10d %12.2f %12.1f %12.1f %12.1f\n", run.batch_size, ns, run.latencies_ns[NUM_WAKEUPS / 2] / 1000.0,
+               run.latencies_ns[NUM_WAKEUPS * 99 / 100] / 1000.0, run.latencies_ns[NUM_WAKEUPS - 1] / 1000.0);
+    }
+    close(run.fd);
+    return 0;
+}
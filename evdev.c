@@ -0,0 +1,292 @@
+// evdev input, see evdev.h
+
+#include "evdev.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <X11/X.h>
+#include "log.h"
+
+#define EVDEV_READ_CHUNK 64
+#define X_KEY_CODE_OFFSET 8 // X key codes are the kernel's plus 8, as in the evdev and libinput X drivers
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NUM_LONGS(bits) (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+struct FakeEvdevSource {
+    struct EvdevSource base;
+    struct input_event* events;
+    int num_events;
+    int next_event;
+    int chunk_size;
+    int is_grabbed;
+    int num_grab_calls;
+    unsigned long keys[EVDEV_KEY_LONGS];
+};
+
+static int read_evdev_device(struct EvdevSource* source, struct input_event* events, int max_events)
+{
+    ssize_t size = read(source->fd, events, max_events * sizeof(struct input_event));
+    if (size == -1)
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    return (int) (size / (ssize_t) sizeof(struct input_event));
+}
+
+static int grab_evdev_device(struct EvdevSource* source, int grab)
+{
+    return ioctl(source->fd, EVIOCGRAB, grab ? 1 : 0);
+}
+
+static int get_evdev_device_keys(struct EvdevSource* source, unsigned long* keys, size_t size)
+{
+    return ioctl(source->fd, EVIOCGKEY(size), keys) < 0 ? -1 : 0;
+}
+
+static int has_bit(const unsigned long* bits, int bit)
+{
+    return (bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG)) & 1;
+}
+
+static void set_bit(unsigned long* bits, int bit, int value)
+{
+    if (value)
+        bits[bit / BITS_PER_LONG] |= 1UL << (bit % BITS_PER_LONG);
+    else
+        bits[bit / BITS_PER_LONG] &= ~(1UL << (bit % BITS_PER_LONG));
+}
+
+struct EvdevSource* open_evdev_device(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+    {
+        logg(LOG_ERROR, "could not open %s: %s. Is the user allowed to (e.g. in the input group)?\n", path, strerror(errno));
+        return NULL;
+    }
+
+    // same clock as the timers, instead of the settable CLOCK_REALTIME
+    int clock_id = CLOCK_MONOTONIC;
+    if (ioctl(fd, EVIOCSCLOCKID, &clock_id) == -1)
+        logg(LOG_WARN, "could not switch %s to monotonic timestamps: %s\n", path, strerror(errno));
+
+    unsigned long rel_bits[NUM_LONGS(REL_CNT)];
+    memset(rel_bits, 0, sizeof(rel_bits));
+    ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel_bits)), rel_bits);
+
+    struct EvdevSource* source = calloc(1, sizeof(*source));
+    source->name = path;
+    source->fd = fd;
+    source->is_pointer = has_bit(rel_bits, REL_X) && has_bit(rel_bits, REL_Y);
+    source->read = read_evdev_device;
+    source->grab = grab_evdev_device;
+    source->get_keys = get_evdev_device_keys;
+    return source;
+}
+
+static int read_fake_source(struct EvdevSource* source, struct input_event* events, int max_events)
+{
+    struct FakeEvdevSource* fake = (struct FakeEvdevSource*) source;
+    int n = fake->num_events - fake->next_event;
+    if (n > max_events) n = max_events;
+    if (n > fake->chunk_size) n = fake->chunk_size;
+    memcpy(events, fake->events + fake->next_event, n * sizeof(struct input_event));
+    fake->next_event += n;
+    return n;
+}
+
+static int grab_fake_source(struct EvdevSource* source, int grab)
+{
+    struct FakeEvdevSource* fake = (struct FakeEvdevSource*) source;
+    fake->is_grabbed = grab;
+    fake->num_grab_calls++;
+    return 0;
+}
+
+static int get_fake_source_keys(struct EvdevSource* source, unsigned long* keys, size_t size)
+{
+    struct FakeEvdevSource* fake = (struct FakeEvdevSource*) source;
+    memcpy(keys, fake->keys, size < sizeof(fake->keys) ? size : sizeof(fake->keys));
+    return 0;
+}
+
+void set_fake_evdev_source_keys(struct EvdevSource* source, const int* codes, int num_codes)
+{
+    struct FakeEvdevSource* fake = (struct FakeEvdevSource*) source;
+    memset(fake->keys, 0, sizeof(fake->keys));
+    for (int i = 0; i < num_codes; i++)
+        set_bit(fake->keys, codes[i], 1);
+}
+
+int fake_evdev_source_grab_calls(struct EvdevSource* source, int* is_grabbed)
+{
+    struct FakeEvdevSource* fake = (struct FakeEvdevSource*) source;
+    *is_grabbed = fake->is_grabbed;
+    return fake->num_grab_calls;
+}
+
+struct EvdevSource* create_fake_evdev_source(const struct input_event* events, int num_events, int chunk_size, int is_pointer)
+{
+    struct FakeEvdevSource* fake = calloc(1, sizeof(*fake));
+    fake->base = (struct EvdevSource)
+    {
+        .name = "fake",
+        .fd = -1,
+        .is_pointer = is_pointer,
+        .read = read_fake_source,
+        .grab = grab_fake_source,
+        .get_keys = get_fake_source_keys,
+    };
+    fake->events = malloc(num_events * sizeof(struct input_event));
+    memcpy(fake->events, events, num_events * sizeof(struct input_event));
+    fake->num_events = num_events;
+    fake->chunk_size = chunk_size > 0 ? chunk_size : 1;
+    return &fake->base;
+}
+
+static int modifier_mask(int code)
+{
+    switch (code)
+    {
+    case KEY_LEFTSHIFT:
+    case KEY_RIGHTSHIFT: return ShiftMask;
+    case KEY_LEFTCTRL:
+    case KEY_RIGHTCTRL: return ControlMask;
+    case KEY_LEFTALT: return Mod1Mask;
+    case KEY_LEFTMETA:
+    case KEY_RIGHTMETA: return Mod4Mask;
+    case KEY_RIGHTALT: return Mod5Mask; // AltGr
+    default: return 0;
+    }
+}
+
+static int64_t event_time_us(const struct input_event* ev)
+{
+    return (int64_t) ev->input_event_sec * 1000000 + ev->input_event_usec;
+}
+
+static int is_button(int code)
+{
+    return code >= BTN_MISC && code < KEY_OK;
+}
+
+// after lost events: the keys released meanwhile are released now, the modifiers are those held now
+static void resync_keys(struct EvdevInput* input, struct EvdevCallbacks* callbacks, int64_t time_us)
+{
+    unsigned long keys[EVDEV_KEY_LONGS];
+    memset(keys, 0, sizeof(keys));
+    if (input->source->get_keys(input->source, keys, sizeof(keys)) != 0)
+    {
+        // taken as all released, rather than leave the trigger key held
+        logg(LOG_WARN, "could not read the keys of %s after lost events: %s\n", input->source->name, strerror(errno));
+        memset(keys, 0, sizeof(keys));
+    }
+
+    for (int code = 0; code < KEY_CNT; code++)
+    {
+        if (is_button(code) || !has_bit(input->keys_down, code) || has_bit(keys, code)) continue;
+        logg(LOG_DEBUG, "%s: key %d was released while events were lost\n", input->source->name, code);
+        callbacks->on_key(callbacks->data, code + X_KEY_CODE_OFFSET, input->modifiers, 0, 0, time_us);
+    }
+
+    memcpy(input->keys_down, keys, sizeof(keys));
+    input->modifiers = 0;
+    for (int code = 0; code < KEY_CNT; code++)
+    {
+        if (has_bit(keys, code))
+            input->modifiers |= modifier_mask(code);
+    }
+}
+
+void evdev_process_events(struct EvdevInput* input, const struct input_event* events, int num_events, struct EvdevCallbacks* callbacks)
+{
+    for (int i = 0; i < num_events; i++)
+    {
+        const struct input_event* ev = &events[i];
+        if (input->is_dropping)
+        {
+            // the rest of the report the kernel lost events of, it is incomplete
+            if (ev->type == EV_SYN && ev->code == SYN_REPORT)
+            {
+                input->is_dropping = 0;
+                resync_keys(input, callbacks, event_time_us(ev));
+            }
+            continue;
+        }
+        switch (ev->type)
+        {
+        case EV_REL:
+            if (ev->code == REL_X)
+                input->delta_x += ev->value;
+            else if (ev->code == REL_Y)
+                input->delta_y += ev->value;
+            else
+                break;
+            input->has_motion = 1;
+            break;
+        case EV_KEY:
+        {
+            if (is_button(ev->code) || ev->code >= KEY_CNT) break; // buttons, not keys
+            int is_press = ev->value != 0;
+            set_bit(input->keys_down, ev->code, is_press);
+            // modifiers as held before this key, like the state of an X key event
+            callbacks->on_key(callbacks->data, ev->code + X_KEY_CODE_OFFSET, input->modifiers, is_press, ev->value == 2, event_time_us(ev));
+            if (is_press)
+                input->modifiers |= modifier_mask(ev->code);
+            else
+                input->modifiers &= ~modifier_mask(ev->code);
+            break;
+        }
+        case EV_SYN:
+            if (ev->code == SYN_DROPPED)
+            {
+                // the kernel buffer overflowed: everything up to and including the next SYN_REPORT is discarded
+                input->delta_x = input->delta_y = 0;
+                input->has_motion = 0;
+                input->is_dropping = 1;
+                break;
+            }
+            if (ev->code != SYN_REPORT || !input->has_motion) break;
+            callbacks->on_motion(callbacks->data, input->index, input->delta_x, input->delta_y, event_time_us(ev));
+            input->delta_x = input->delta_y = 0;
+            input->has_motion = 0;
+            break;
+        }
+    }
+}
+
+int evdev_read_pending(struct EvdevInput* input, struct EvdevCallbacks* callbacks)
+{
+    struct input_event events[EVDEV_READ_CHUNK];
+    int total = 0;
+    while (1)
+    {
+        int n = input->source->read(input->source, events, EVDEV_READ_CHUNK);
+        if (n == -1) return -1;
+        if (n == 0) return total;
+        evdev_process_events(input, events, n, callbacks);
+        total += n;
+    }
+}
+
+void evdev_set_grabbed(struct EvdevInput* input, int grab)
+{
+    if (!input->source->is_pointer || input->is_grabbed == grab) return;
+    if (input->source->grab(input->source, grab) != 0)
+    {
+        logg(LOG_WARN, "could not %s %s: %s\n", grab ? "grab" : "release", input->source->name, strerror(errno));
+        return;
+    }
+    input->is_grabbed = grab;
+}
+
+void evdev_set_all_grabbed(struct EvdevInput* inputs, int num_inputs, int grab)
+{
+    for (int i = 0; i < num_inputs; i++)
+        evdev_set_grabbed(&inputs[i], grab);
+}
@@ -0,0 +1,66 @@
+// input straight from the kernel's /dev/input/event* devices, instead of XInput2 raw events.
+// no X round trip, and it works without XI2. Pointer devices are grabbed exclusively while scrolling,
+// which keeps the pointer in place without barriers or warping.
+
+#ifndef EVDEV_H
+#define EVDEV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/input.h>
+
+#define EVDEV_KEY_LONGS ((KEY_CNT + sizeof(long) * 8 - 1) / (sizeof(long) * 8)) // a bitmask of all keys
+
+// a source of evdev events: a device node, or a fake fed with prepared events
+struct EvdevSource {
+    const char* name;
+    int fd; // to wait for, -1 for a fake source
+    int is_pointer; // reports relative motion, grabbed while scrolling
+    // returns the number of events read, 0 if there are none pending, -1 on error (the device is gone)
+    int (*read)(struct EvdevSource* source, struct input_event* events, int max_events);
+    // returns 0 on success
+    int (*grab)(struct EvdevSource* source, int grab);
+    // the keys held now, into a bitmask of size bytes. Returns 0 on success
+    int (*get_keys)(struct EvdevSource* source, unsigned long* keys, size_t size);
+};
+
+// what the events of a device amount to. Times are CLOCK_MONOTONIC in µs.
+struct EvdevCallbacks {
+    void (*on_motion)(void* data, int source_index, double delta_x, double delta_y, int64_t time_us);
+    // key_code is an X key code, modifiers an X modifier mask of the modifier keys held on the device before it
+    void (*on_key)(void* data, int key_code, int modifiers, int is_press, int is_repeat, int64_t time_us);
+    void* data;
+};
+
+// state of one device: motion is summed until the report is complete (SYN_REPORT), held keys are tracked.
+// after SYN_DROPPED everything up to the next SYN_REPORT is discarded, then the held keys are read from the
+// device: the keys released meanwhile get a release, so a lost trigger key release doesn't leave scrolling on
+struct EvdevInput {
+    struct EvdevSource* source;
+    int index;
+    double delta_x;
+    double delta_y;
+    int has_motion;
+    int modifiers;
+    unsigned long keys_down[EVDEV_KEY_LONGS];
+    int is_dropping; // events were lost, waiting for the next SYN_REPORT
+    int is_grabbed;
+};
+
+// opens the device non-blocking with CLOCK_MONOTONIC timestamps. NULL on failure
+struct EvdevSource* open_evdev_device(const char* path);
+// a source that hands out the given events (copied) in chunks of at most chunk_size, then reports none pending
+struct EvdevSource* create_fake_evdev_source(const struct input_event* events, int num_events, int chunk_size, int is_pointer);
+// the keys a fake source reports as held, when asked after lost events. None until set
+void set_fake_evdev_source_keys(struct EvdevSource* source, const int* codes, int num_codes);
+// how often a fake source was asked to grab or release, and whether it is grabbed now
+int fake_evdev_source_grab_calls(struct EvdevSource* source, int* is_grabbed);
+
+void evdev_process_events(struct EvdevInput* input, const struct input_event* events, int num_events, struct EvdevCallbacks* callbacks);
+// reads and processes everything pending. Returns the number of events, -1 if the device is gone
+int evdev_read_pending(struct EvdevInput* input, struct EvdevCallbacks* callbacks);
+void evdev_set_grabbed(struct EvdevInput* input, int grab);
+// the pointer devices among inputs, while scrolling is active
+void evdev_set_all_grabbed(struct EvdevInput* inputs, int num_inputs, int grab);
+
+#endif // EVDEV_H
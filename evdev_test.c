@@ -0,0 +1,276 @@
+// evdev input from fake sources: motion summed per report, keys with their modifiers, and the pointer
+// grabbed while the trigger key activates scrolling
+
+#include <string.h>
+#include <X11/X.h>
+#include "evdev.h"
+#include "log.h"
+#include "test.h"
+
+#define MAX_CAPTURED 64
+#define X_KEY_CODE(code) ((code) + 8)
+
+struct CapturedMotion {
+    int source_index;
+    double delta_x;
+    double delta_y;
+    int64_t time_us;
+};
+
+struct CapturedKey {
+    int key_code;
+    int modifiers;
+    int is_press;
+    int is_repeat;
+    int64_t time_us;
+};
+
+// what the callbacks were called with, and a stand-in for the event loop's activation by the trigger key
+struct Capture {
+    struct CapturedMotion motions[MAX_CAPTURED];
+    int num_motions;
+    struct CapturedKey keys[MAX_CAPTURED];
+    int num_keys;
+    int trigger_key_code;
+    struct EvdevInput* inputs;
+    int num_inputs;
+    int is_active;
+};
+
+static void on_motion(void* data, int source_index, double delta_x, double delta_y, int64_t time_us)
+{
+    struct Capture* capture = (struct Capture*) data;
+    if (capture->num_motions == MAX_CAPTURED) return;
+    capture->motions[capture->num_motions++] = (struct CapturedMotion) { source_index, delta_x, delta_y, time_us };
+}
+
+static void on_key(void* data, int key_code, int modifiers, int is_press, int is_repeat, int64_t time_us)
+{
+    struct Capture* capture = (struct Capture*) data;
+    if (capture->num_keys < MAX_CAPTURED)
+        capture->keys[capture->num_keys++] = (struct CapturedKey) { key_code, modifiers, is_press, is_repeat, time_us };
+    if (key_code != capture->trigger_key_code || is_repeat) return;
+
+    // like set_is_active and handle_key_press with FIXATE_BY_GRABBING
+    capture->is_active = is_press;
+    evdev_set_all_grabbed(capture->inputs, capture->num_inputs, is_press);
+}
+
+static struct input_event ev(int64_t time_us, int type, int code, int value)
+{
+    struct input_event event;
+    memset(&event, 0, sizeof(event));
+    event.input_event_sec = time_us / 1000000;
+    event.input_event_usec = time_us % 1000000;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    return event;
+}
+
+static void test_motion(int chunk_size)
+{
+    const struct input_event events[] =
+    {
+        ev(1000, EV_REL, REL_X, 3),
+        ev(1000, EV_REL, REL_Y, -4),
+        ev(1000, EV_REL, REL_Y, -1),
+        ev(1000, EV_SYN, SYN_REPORT, 0),
+        // a report without motion reports none
+        ev(2000, EV_MSC, MSC_SCAN, 30),
+        ev(2000, EV_SYN, SYN_REPORT, 0),
+        // the wheel is no motion
+        ev(3000, EV_REL, REL_WHEEL, 1),
+        ev(3000, EV_SYN, SYN_REPORT, 0),
+        // the kernel lost events: this report and everything up to the next SYN_REPORT don't count
+        ev(4000, EV_REL, REL_Y, 50),
+        ev(4000, EV_SYN, SYN_DROPPED, 0),
+        ev(4500, EV_REL, REL_Y, 20),
+        ev(4500, EV_REL, REL_X, -8),
+        ev(4500, EV_SYN, SYN_REPORT, 0),
+        ev(1005000, EV_REL, REL_Y, 7),
+        ev(1005000, EV_SYN, SYN_REPORT, 0),
+    };
+    int num_events = sizeof(events) / sizeof(events[0]);
+    struct EvdevSource* source = create_fake_evdev_source(events, num_events, chunk_size, 1);
+    struct EvdevInput input = { .source = source, .index = 2 };
+    struct Capture capture = { .trigger_key_code = -1 };
+    struct EvdevCallbacks callbacks = { .on_motion = on_motion, .on_key = on_key, .data = &capture };
+
+    // a report split across reads is still summed up to its SYN_REPORT
+    CHECK(evdev_read_pending(&input, &callbacks) == num_events);
+    CHECK(capture.num_motions == 2);
+    CHECK(capture.motions[0].source_index == 2);
+    CHECK(capture.motions[0].delta_x == 3 && capture.motions[0].delta_y == -5);
+    CHECK(capture.motions[0].time_us == 1000);
+    CHECK(capture.motions[1].delta_x == 0 && capture.motions[1].delta_y == 7);
+    CHECK(capture.motions[1].time_us == 1005000);
+    CHECK(capture.num_keys == 0);
+
+    // drained
+    CHECK(evdev_read_pending(&input, &callbacks) == 0);
+}
+
+static void test_keys()
+{
+    const struct input_event events[] =
+    {
+        ev(1000, EV_KEY, KEY_LEFTCTRL, 1),
+        ev(1000, EV_SYN, SYN_REPORT, 0),
+        ev(2000, EV_KEY, KEY_A, 1),
+        ev(2000, EV_SYN, SYN_REPORT, 0),
+        ev(3000, EV_KEY, KEY_A, 2),
+        ev(3000, EV_SYN, SYN_REPORT, 0),
+        // buttons are not keys
+        ev(3500, EV_KEY, BTN_LEFT, 1),
+        ev(3500, EV_SYN, SYN_REPORT, 0),
+        ev(4000, EV_KEY, KEY_LEFTCTRL, 0),
+        ev(4000, EV_SYN, SYN_REPORT, 0),
+        ev(5000, EV_KEY, KEY_A, 0),
+        ev(5000, EV_SYN, SYN_REPORT, 0),
+    };
+    struct EvdevSource* source = create_fake_evdev_source(events, sizeof(events) / sizeof(events[0]), 64, 0);
+    struct EvdevInput input = { .source = source };
+    struct Capture capture = { .trigger_key_code = -1 };
+    struct EvdevCallbacks callbacks = { .on_motion = on_motion, .on_key = on_key, .data = &capture };
+    evdev_read_pending(&input, &callbacks);
+
+    CHECK(capture.num_motions == 0);
+    CHECK(capture.num_keys == 5);
+    // X key codes, with the modifiers held before the key
+    CHECK(capture.keys[0].key_code == X_KEY_CODE(KEY_LEFTCTRL) && capture.keys[0].is_press && capture.keys[0].modifiers == 0);
+    CHECK(capture.keys[1].key_code == X_KEY_CODE(KEY_A) && capture.keys[1].is_press && !capture.keys[1].is_repeat);
+    CHECK(capture.keys[1].modifiers == ControlMask);
+    CHECK(capture.keys[1].time_us == 2000);
+    CHECK(capture.keys[2].key_code == X_KEY_CODE(KEY_A) && capture.keys[2].is_press && capture.keys[2].is_repeat);
+    CHECK(capture.keys[3].key_code == X_KEY_CODE(KEY_LEFTCTRL) && !capture.keys[3].is_press);
+    CHECK(capture.keys[4].key_code == X_KEY_CODE(KEY_A) && !capture.keys[4].is_press && capture.keys[4].modifiers == 0);
+}
+
+// a release lost with dropped events is made up for once the report is over, from the keys held then
+static void test_keys_lost()
+{
+    const struct input_event events[] =
+    {
+        ev(1000, EV_KEY, KEY_LEFTCTRL, 1),
+        ev(1000, EV_SYN, SYN_REPORT, 0),
+        ev(2000, EV_KEY, KEY_F9, 1),
+        ev(2000, EV_SYN, SYN_REPORT, 0),
+        ev(2500, EV_SYN, SYN_DROPPED, 0),
+        // lost: the trigger released, shift pressed
+        ev(3000, EV_KEY, KEY_F9, 0),
+        ev(3000, EV_KEY, KEY_LEFTSHIFT, 1),
+        ev(3000, EV_SYN, SYN_REPORT, 0),
+        ev(4000, EV_KEY, KEY_A, 1),
+        ev(4000, EV_SYN, SYN_REPORT, 0),
+    };
+    const struct input_event pointer_events[] = { ev(1000, EV_SYN, SYN_REPORT, 0) };
+    struct EvdevInput inputs[2] =
+    {
+        { .source = create_fake_evdev_source(events, sizeof(events) / sizeof(events[0]), 3, 0), .index = 0 },
+        { .source = create_fake_evdev_source(pointer_events, 1, 64, 1), .index = 1 },
+    };
+    const int held[] = { KEY_LEFTCTRL, KEY_LEFTSHIFT };
+    set_fake_evdev_source_keys(inputs[0].source, held, 2);
+    struct Capture capture = { .trigger_key_code = X_KEY_CODE(KEY_F9), .inputs = inputs, .num_inputs = 2 };
+    struct EvdevCallbacks callbacks = { .on_motion = on_motion, .on_key = on_key, .data = &capture };
+    evdev_read_pending(&inputs[0], &callbacks);
+
+    // ctrl, F9, the made up F9 release, a
+    CHECK(capture.num_keys == 4);
+    CHECK(capture.keys[2].key_code == X_KEY_CODE(KEY_F9) && !capture.keys[2].is_press);
+    CHECK(capture.keys[2].time_us == 3000);
+    // scrolling ended and let go of the pointer
+    CHECK(!capture.is_active);
+    CHECK(!inputs[1].is_grabbed);
+    int is_grabbed;
+    CHECK(fake_evdev_source_grab_calls(inputs[1].source, &is_grabbed) == 2 && !is_grabbed);
+    // the modifiers are those held after the loss, shift included
+    CHECK(capture.keys[3].key_code == X_KEY_CODE(KEY_A) && capture.keys[3].is_press);
+    CHECK(capture.keys[3].modifiers == (ControlMask | ShiftMask));
+
+    // ctrl released while lost as well: no modifiers anymore
+    const struct input_event more_events[] =
+    {
+        ev(5000, EV_SYN, SYN_DROPPED, 0),
+        ev(5000, EV_SYN, SYN_REPORT, 0),
+        ev(6000, EV_KEY, KEY_B, 1),
+        ev(6000, EV_SYN, SYN_REPORT, 0),
+    };
+    inputs[0].source = create_fake_evdev_source(more_events, 4, 64, 0);
+    const int held_now[] = { KEY_A };
+    set_fake_evdev_source_keys(inputs[0].source, held_now, 1);
+    capture.num_keys = 0;
+    evdev_read_pending(&inputs[0], &callbacks);
+    // releases of ctrl and shift, b
+    CHECK(capture.num_keys == 3);
+    CHECK(!capture.keys[0].is_press && !capture.keys[1].is_press);
+    CHECK(capture.keys[2].key_code == X_KEY_CODE(KEY_B) && capture.keys[2].modifiers == 0);
+}
+
+// the pointer is grabbed from the trigger key press to its release, the keyboard never is
+static void test_grab_follows_activation()
+{
+    const struct input_event keyboard_events[] =
+    {
+        ev(1000, EV_KEY, KEY_F9, 1),
+        ev(1000, EV_SYN, SYN_REPORT, 0),
+        ev(1500, EV_KEY, KEY_F9, 2),
+        ev(1500, EV_SYN, SYN_REPORT, 0),
+    };
+    const struct input_event keyboard_release_events[] =
+    {
+        ev(2000, EV_KEY, KEY_F9, 0),
+        ev(2000, EV_SYN, SYN_REPORT, 0),
+    };
+    const struct input_event pointer_events[] =
+    {
+        ev(1200, EV_REL, REL_Y, 4),
+        ev(1200, EV_SYN, SYN_REPORT, 0),
+    };
+    struct EvdevInput inputs[2] =
+    {
+        { .source = create_fake_evdev_source(keyboard_events, 4, 64, 0), .index = 0 },
+        { .source = create_fake_evdev_source(pointer_events, 2, 64, 1), .index = 1 },
+    };
+    struct Capture capture = { .trigger_key_code = X_KEY_CODE(KEY_F9), .inputs = inputs, .num_inputs = 2 };
+    struct EvdevCallbacks callbacks = { .on_motion = on_motion, .on_key = on_key, .data = &capture };
+    int is_grabbed;
+
+    CHECK(fake_evdev_source_grab_calls(inputs[1].source, &is_grabbed) == 0 && !is_grabbed);
+
+    // the press grabs, its repeat doesn't grab again
+    evdev_read_pending(&inputs[0], &callbacks);
+    CHECK(capture.is_active);
+    CHECK(inputs[1].is_grabbed);
+    CHECK(fake_evdev_source_grab_calls(inputs[1].source, &is_grabbed) == 1 && is_grabbed);
+    CHECK(!inputs[0].is_grabbed);
+    CHECK(fake_evdev_source_grab_calls(inputs[0].source, &is_grabbed) == 0 && !is_grabbed);
+
+    // the grabbed pointer's motion still comes in
+    evdev_read_pending(&inputs[1], &callbacks);
+    CHECK(capture.num_motions == 1 && capture.motions[0].source_index == 1 && capture.motions[0].delta_y == 4);
+
+    // the release lets go
+    inputs[0].source = create_fake_evdev_source(keyboard_release_events, 2, 64, 0);
+    evdev_read_pending(&inputs[0], &callbacks);
+    CHECK(!capture.is_active);
+    CHECK(!inputs[1].is_grabbed);
+    CHECK(fake_evdev_source_grab_calls(inputs[1].source, &is_grabbed) == 2 && !is_grabbed);
+
+    // letting go again does nothing
+    evdev_set_all_grabbed(inputs, 2, 0);
+    CHECK(fake_evdev_source_grab_calls(inputs[1].source, &is_grabbed) == 2);
+}
+
+int main()
+{
+    log_level = LOG_WARN;
+    test_motion(64);
+    test_motion(1);
+    test_motion(3);
+    test_keys();
+    test_keys_lost();
+    test_grab_follows_activation();
+    return TEST_RESULT();
+}
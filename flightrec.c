@@ -0,0 +1,88 @@
+// flight recorder, see flightrec.h
+
+#include "flightrec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.h"
+
+static const char* FLIGHT_RECORD_TYPE_NAMES[] = { "?", "raw", "motion", "scroll", "limited", "discarded" };
+
+int flight_recorder_init(struct FlightRecorder* recorder, int duration_s)
+{
+    unsigned long capacity = 1;
+    while (capacity < (unsigned long) duration_s * FLIGHT_RECORDS_PER_S)
+        capacity <<= 1;
+
+    memset(recorder, 0, sizeof(*recorder));
+    // faulted in up front, so recording never does. calloc'ed pages would only be mapped on the first write
+    void* records = mmap(NULL, capacity * sizeof(struct FlightRecord), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (records == MAP_FAILED)
+    {
+        logg(LOG_ERROR, "could not allocate the flight recorder: %s\n", strerror(errno));
+        return -1;
+    }
+    recorder->records = records;
+    recorder->mask = capacity - 1;
+    recorder->duration_ms = duration_s * 1000;
+    return 0;
+}
+
+// not through a symlink or into someone else's file, the path can be in a shared directory like /tmp.
+// emptied only once it is known to be ours. Returns the fd, -1 on failure
+static int open_own_file(const char* path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd == -1) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0)
+    {
+        if (st.st_uid != geteuid())
+            errno = EPERM;
+        else if (ftruncate(fd, 0) == 0)
+            return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+int flight_recorder_dump(struct FlightRecorder* recorder, const char* path)
+{
+    int fd = open_own_file(path);
+    FILE* file = fd != -1 ? fdopen(fd, "w") : NULL;
+    if (file == NULL)
+    {
+        logg(LOG_ERROR, "could not write the flight recorder to %s: %s\n", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return -1;
+    }
+
+    unsigned long end = recorder->next;
+    unsigned long start = end > recorder->mask + 1 ? end - (recorder->mask + 1) : 0;
+    EventTime last_time = end > 0 ? recorder->records[(end - 1) & recorder->mask].time : 0;
+
+    fprintf(file, "# time_ms type direction source a b\n");
+    unsigned long written = 0;
+    for (unsigned long i = start; i < end; i++)
+    {
+        const struct FlightRecord* record = &recorder->records[i & recorder->mask];
+        if ((int32_t) (last_time - record->time) > recorder->duration_ms) continue;
+
+        fprintf(file, "%u %s %s %u %g %g\n", record->time,
+                record->type <= FLIGHT_BACKLOG_DISCARDED ? FLIGHT_RECORD_TYPE_NAMES[record->type] : "?",
+                record->direction == SCROLL_VERTICAL ? "v" : record->direction == SCROLL_HORIZONTAL ? "h" : "-",
+                record->source_id, record->a, record->b);
+        written++;
+    }
+    fclose(file);
+    logg(LOG_INFO, "wrote %lu flight recorder events to %s\n", written, path);
+    return 0;
+}
@@ -0,0 +1,60 @@
+// flight recorder: a preallocated ring that always holds the most recent motion and the scroll decisions made on
+// it, to find out after the fact what led to a scroll (or none). Nothing is written anywhere until it is dumped.
+// recording an event is a 16 byte store into the ring, cheap enough to leave on. The ring has one writer, the
+// thread running the conversion, which also dumps it.
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "scrollcore.h"
+
+#define FLIGHT_RECORDS_PER_S 2048 // a 1000 Hz mouse plus the decisions on it
+
+enum FlightRecordType
+{
+    FLIGHT_RAW_MOTION = 1,    // a: delta x, b: delta y, as reported by the device
+    FLIGHT_MOTION,            // a: delta x, b: delta y, handed to the conversion (a batch of raw motion)
+    FLIGHT_SCROLL,            // a: clicks sent, b: movement left over
+    FLIGHT_RATE_LIMITED,      // a: movement held back, b: tokens left
+    FLIGHT_BACKLOG_DISCARDED  // a: movement discarded, b: movement kept
+};
+
+struct FlightRecord {
+    EventTime time;
+    uint8_t type; // enum FlightRecordType
+    uint8_t direction; // enum ScrollDirection, of decisions
+    uint16_t source_id; // device, of raw motion
+    float a;
+    float b;
+};
+
+struct FlightRecorder {
+    struct FlightRecord* records;
+    unsigned long mask; // capacity - 1, a power of two
+    unsigned long next; // total recorded, the ring index is this & mask
+    int duration_ms; // a dump covers this much before the most recent record
+};
+
+static inline void flight_record(struct FlightRecorder* recorder, EventTime time, enum FlightRecordType type,
+                                 int direction, int source_id, double a, double b)
+{
+    if (recorder == NULL) return;
+
+    struct FlightRecord* record = &recorder->records[recorder->next++ & recorder->mask];
+    record->time = time;
+    record->type = (uint8_t) type;
+    record->direction = (uint8_t) direction;
+    record->source_id = (uint16_t) source_id;
+    record->a = (float) a;
+    record->b = (float) b;
+}
+
+// allocates room for duration_s seconds of records. Returns 0 on success
+int flight_recorder_init(struct FlightRecorder* recorder, int duration_s);
+// writes the recorded events of the last duration_s seconds to path as text, oldest first. The file is created
+// private to the user, a symlink or a file of another user at path is refused. Returns 0 on success
+int flight_recorder_dump(struct FlightRecorder* recorder, const char* path);
+
+#endif // FLIGHTREC_H
@@ -0,0 +1,104 @@
+// kinetic scrolling, see kinetics.h
+
+#include "kinetics.h"
+
+#include <math.h>
+#include "log.h"
+
+void kinetics_record_motion(struct Kinetics* kinetics, EventTime time, double delta_x, double delta_y)
+{
+    kinetics->is_coasting = 0;
+    kinetics->samples[kinetics->next_sample] = (struct MotionSample) { .time = time, .delta_x = delta_x, .delta_y = delta_y };
+    kinetics->next_sample = (kinetics->next_sample + 1) % KINETIC_VELOCITY_SAMPLES;
+    if (kinetics->num_samples < KINETIC_VELOCITY_SAMPLES)
+        kinetics->num_samples++;
+}
+
+static const struct MotionSample* latest_motion_sample(const struct Kinetics* kinetics)
+{
+    return &kinetics->samples[(kinetics->next_sample + KINETIC_VELOCITY_SAMPLES - 1) % KINETIC_VELOCITY_SAMPLES];
+}
+
+EventTime kinetics_latest_motion_time(const struct Kinetics* kinetics)
+{
+    return latest_motion_sample(kinetics)->time;
+}
+
+// average velocity over the samples in the window before the last one. The oldest sample in the window only
+// marks its start, its movement happened before. Returns 0 if there is too little to tell.
+static int estimate_release_velocity(const struct Kinetics* kinetics, double* velocity_x, double* velocity_y)
+{
+    if (kinetics->num_samples < 2) return 0;
+
+    EventTime last_time = latest_motion_sample(kinetics)->time;
+    double sum_x = 0;
+    double sum_y = 0;
+    EventTime span_ms = 0;
+    const struct MotionSample* newer = NULL;
+    for (int n = 0; n < kinetics->num_samples; n++)
+    {
+        const struct MotionSample* sample = &kinetics->samples[(kinetics->next_sample + KINETIC_VELOCITY_SAMPLES - 1 - n) % KINETIC_VELOCITY_SAMPLES];
+        EventTime age_ms = last_time - sample->time;
+        if (age_ms > (EventTime) KINETIC_VELOCITY_WINDOW_MS) break;
+        if (newer != NULL)
+        {
+            // the movement of the newer sample happened between the two
+            sum_x += newer->delta_x;
+            sum_y += newer->delta_y;
+            span_ms = age_ms;
+        }
+        newer = sample;
+    }
+    if (span_ms == 0) return 0;
+
+    *velocity_x = sum_x / span_ms;
+    *velocity_y = sum_y / span_ms;
+    return 1;
+}
+
+int kinetics_release(struct Kinetics* kinetics, const struct KineticsConfig* cfg, EventTime now)
+{
+    double velocity_x, velocity_y;
+    int has_velocity = estimate_release_velocity(kinetics, &velocity_x, &velocity_y);
+    kinetics->num_samples = 0;
+    if (!cfg->allow_horizontal)
+        velocity_x = 0;
+    if (!has_velocity || hypot(velocity_x, velocity_y) < cfg->min_start_speed)
+        return 0;
+
+    logg(LOG_DEBUG, "kinetic scrolling, velocity x %g y %g counts/ms\n", velocity_x, velocity_y);
+    kinetics->velocity_x = velocity_x;
+    kinetics->velocity_y = velocity_y;
+    kinetics->last_tick = now;
+    kinetics->is_coasting = 1;
+    return 1;
+}
+
+int kinetics_step(struct Kinetics* kinetics, const struct KineticsConfig* cfg, EventTime now, double* delta_x, double* delta_y)
+{
+    *delta_x = 0;
+    *delta_y = 0;
+    if (!kinetics->is_coasting) return 0;
+
+    // the clock can be behind the stamp of the last step, no time has passed for the momentum then
+    int32_t elapsed_ms = (int32_t) (now - kinetics->last_tick);
+    if (elapsed_ms <= 0) return 1;
+    double dt_ms = elapsed_ms;
+    kinetics->last_tick = now;
+
+    *delta_x = kinetics->velocity_x * dt_ms;
+    *delta_y = kinetics->velocity_y * dt_ms;
+
+    // viscous friction decays exponentially, dry friction takes away a constant amount of speed
+    double speed = hypot(kinetics->velocity_x, kinetics->velocity_y);
+    double new_speed = speed * exp(-dt_ms / cfg->time_constant_ms) - cfg->friction / 1e6 * dt_ms;
+    if (new_speed < cfg->min_speed)
+    {
+        logg(LOG_DEBUG, "kinetic scrolling stopped\n");
+        kinetics->is_coasting = 0;
+        return 0;
+    }
+    kinetics->velocity_x *= new_speed / speed;
+    kinetics->velocity_y *= new_speed / speed;
+    return 1;
+}
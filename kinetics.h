@@ -0,0 +1,49 @@
+// kinetic scrolling, without X: recent motion, to estimate the velocity when the pointer device is released,
+// and the momentum that keeps scrolling after that until friction stops it.
+// the caller decides when the device was released and steps the momentum, both with the time of its clock.
+
+#ifndef KINETICS_H
+#define KINETICS_H
+
+#include "scrollcore.h"
+
+#define KINETIC_VELOCITY_SAMPLES 16
+#define KINETIC_VELOCITY_WINDOW_MS 100 // motion this recent counts for the release velocity
+
+// speeds in counts per ms
+struct KineticsConfig {
+    double time_constant_ms; // velocity decays by 1/e in this time
+    double friction; // constant deceleration in counts/s²
+    double min_start_speed; // slower releases just stop
+    double min_speed; // momentum stops below this
+    int allow_horizontal;
+};
+
+struct MotionSample {
+    EventTime time;
+    double delta_x;
+    double delta_y;
+};
+
+struct Kinetics {
+    struct MotionSample samples[KINETIC_VELOCITY_SAMPLES]; // ring, oldest overwritten
+    int next_sample;
+    int num_samples;
+    int is_coasting;
+    double velocity_x; // counts per ms
+    double velocity_y;
+    EventTime last_tick;
+};
+
+// new motion, takes over from the momentum
+void kinetics_record_motion(struct Kinetics* kinetics, EventTime time, double delta_x, double delta_y);
+// of the latest recorded motion, the kinetics must have some
+EventTime kinetics_latest_motion_time(const struct Kinetics* kinetics);
+// the device was released: starts coasting with the velocity of the recent motion if it was fast enough, and
+// forgets the motion. Returns 1 if it coasts
+int kinetics_release(struct Kinetics* kinetics, const struct KineticsConfig* cfg, EventTime now);
+// one step of momentum: the movement the velocity covers since the last step, into delta_x and delta_y, then
+// friction. Returns 0 once the momentum stopped, after the last movement
+int kinetics_step(struct Kinetics* kinetics, const struct KineticsConfig* cfg, EventTime now, double* delta_x, double* delta_y);
+
+#endif // KINETICS_H
@@ -0,0 +1,156 @@
+// momentum scrolling with a fake clock: a flick, then 16 ms steps until friction stops it
+
+#include "kinetics.h"
+#include "test.h"
+#include <string.h>
+
+static const int TICK_MS = 16;
+
+// 10 counts every 8 ms for a while, then the device is released 40 ms after the last motion
+static EventTime flick(struct Kinetics* kinetics, const struct KineticsConfig* cfg, double delta_x, double delta_y)
+{
+    memset(kinetics, 0, sizeof(*kinetics));
+    EventTime time = 1000;
+    for (int n = 0; n < 10; n++, time += 8)
+        kinetics_record_motion(kinetics, time, delta_x, delta_y);
+    time += 40;
+    CHECK(kinetics_release(kinetics, cfg, time));
+    CHECK(kinetics->is_coasting);
+    return time;
+}
+
+// viscous friction only (-k): the speed decays by exp(-t / time constant) and stops below the minimum
+static void test_exponential_decay()
+{
+    struct KineticsConfig cfg = { .time_constant_ms = 200, .friction = 0, .min_start_speed = 0.1, .min_speed = 0.05, .allow_horizontal = 1 };
+    struct Kinetics kinetics;
+    EventTime now = flick(&kinetics, &cfg, 0, 10);
+    CHECK_NEAR(kinetics.velocity_y, 10.0 / 8, 1e-9);
+    CHECK_NEAR(kinetics.velocity_x, 0, 1e-9);
+
+    double velocity = 10.0 / 8;
+    double total = 0;
+    int steps = 0;
+    int is_coasting = 1;
+    while (is_coasting && steps < 1000)
+    {
+        now += TICK_MS;
+        double delta_x, delta_y;
+        is_coasting = kinetics_step(&kinetics, &cfg, now, &delta_x, &delta_y);
+        steps++;
+        CHECK_NEAR(delta_x, 0, 1e-9);
+        CHECK_NEAR(delta_y, velocity * TICK_MS, 1e-9);
+        total += delta_y;
+        velocity *= exp(-TICK_MS / cfg.time_constant_ms);
+        if (is_coasting)
+            CHECK_NEAR(kinetics.velocity_y, velocity, 1e-9);
+    }
+    CHECK(!is_coasting);
+    CHECK(!kinetics.is_coasting);
+    // 1.25 * exp(-16 n / 200) < 0.05 first for n = 41
+    CHECK(steps == 41);
+    // about the integral of the velocity, 1.25 * 200 counts
+    CHECK(total > 0.9 * 250 && total < 1.1 * 250);
+
+    // stopped momentum stays stopped
+    double delta_x, delta_y;
+    CHECK(!kinetics_step(&kinetics, &cfg, now + TICK_MS, &delta_x, &delta_y));
+    CHECK(delta_x == 0 && delta_y == 0);
+}
+
+// dry friction only (-K): the speed drops by the same amount each step, in a time that follows from it
+static void test_constant_deceleration()
+{
+    // counts/s², 0.004 counts/ms less speed each 16 ms
+    struct KineticsConfig cfg = { .time_constant_ms = 1e12, .friction = 250, .min_start_speed = 0.1, .min_speed = 0.052, .allow_horizontal = 1 };
+    struct Kinetics kinetics;
+    EventTime now = flick(&kinetics, &cfg, 0, -10);
+
+    double speed = 10.0 / 8;
+    int steps = 0;
+    int is_coasting = 1;
+    while (is_coasting && steps < 1000)
+    {
+        now += TICK_MS;
+        double delta_x, delta_y;
+        is_coasting = kinetics_step(&kinetics, &cfg, now, &delta_x, &delta_y);
+        steps++;
+        CHECK_NEAR(delta_y, -speed * TICK_MS, 1e-6);
+        speed -= cfg.friction / 1e6 * TICK_MS;
+        if (is_coasting)
+            CHECK_NEAR(kinetics.velocity_y, -speed, 1e-6);
+    }
+    CHECK(!is_coasting);
+    // 1.25 - 0.004 n < 0.052 first for n = 300
+    CHECK(steps == 300);
+}
+
+// the momentum keeps the direction of the flick, horizontal only if allowed
+static void test_direction()
+{
+    struct KineticsConfig cfg = { .time_constant_ms = 200, .friction = 0, .min_start_speed = 0.1, .min_speed = 0.05, .allow_horizontal = 1 };
+    struct Kinetics kinetics;
+    EventTime now = flick(&kinetics, &cfg, 6, 8);
+    now += TICK_MS;
+    double delta_x, delta_y;
+    CHECK(kinetics_step(&kinetics, &cfg, now, &delta_x, &delta_y));
+    CHECK_NEAR(delta_x, 6.0 / 8 * TICK_MS, 1e-9);
+    CHECK_NEAR(delta_y, 8.0 / 8 * TICK_MS, 1e-9);
+    CHECK_NEAR(kinetics.velocity_x / kinetics.velocity_y, 6.0 / 8, 1e-9);
+
+    cfg.allow_horizontal = 0;
+    flick(&kinetics, &cfg, 6, 8);
+    CHECK(kinetics.velocity_x == 0);
+}
+
+static void test_no_flick()
+{
+    struct KineticsConfig cfg = { .time_constant_ms = 200, .friction = 0, .min_start_speed = 0.1, .min_speed = 0.05, .allow_horizontal = 1 };
+    struct Kinetics kinetics;
+
+    // too slow to start
+    memset(&kinetics, 0, sizeof(kinetics));
+    for (int n = 0; n < 10; n++)
+        kinetics_record_motion(&kinetics, 1000 + n * 8, 0, 0.5);
+    CHECK(!kinetics_release(&kinetics, &cfg, 1112));
+    CHECK(!kinetics.is_coasting);
+
+    // a single motion tells no velocity
+    memset(&kinetics, 0, sizeof(kinetics));
+    kinetics_record_motion(&kinetics, 1000, 0, 100);
+    CHECK(!kinetics_release(&kinetics, &cfg, 1040));
+
+    // motion older than the window does not count
+    memset(&kinetics, 0, sizeof(kinetics));
+    kinetics_record_motion(&kinetics, 1000, 0, 100);
+    kinetics_record_motion(&kinetics, 1000 + KINETIC_VELOCITY_WINDOW_MS + 1, 0, 100);
+    CHECK(!kinetics_release(&kinetics, &cfg, 1200));
+}
+
+// new motion takes over, and a clock behind the last step scrolls nothing yet
+static void test_interruptions()
+{
+    struct KineticsConfig cfg = { .time_constant_ms = 200, .friction = 0, .min_start_speed = 0.1, .min_speed = 0.05, .allow_horizontal = 1 };
+    struct Kinetics kinetics;
+    EventTime now = flick(&kinetics, &cfg, 0, 10);
+
+    double delta_x, delta_y;
+    CHECK(kinetics_step(&kinetics, &cfg, now - 5, &delta_x, &delta_y));
+    CHECK(delta_x == 0 && delta_y == 0);
+    CHECK_NEAR(kinetics.velocity_y, 10.0 / 8, 1e-9);
+
+    kinetics_record_motion(&kinetics, now + 1, 0, 1);
+    CHECK(!kinetics.is_coasting);
+    CHECK(!kinetics_step(&kinetics, &cfg, now + TICK_MS, &delta_x, &delta_y));
+    CHECK(delta_x == 0 && delta_y == 0);
+}
+
+int main()
+{
+    test_exponential_decay();
+    test_constant_deceleration();
+    test_direction();
+    test_no_flick();
+    test_interruptions();
+    return TEST_RESULT();
+}
@@ -0,0 +1,85 @@
+// latency histograms, see latency.h
+
+#include "latency.h"
+
+#include <string.h>
+
+static int bucket_index(uint64_t value)
+{
+    if (value < LATENCY_SUB_BUCKETS) return (int) value;
+    if (value >> 32) return LATENCY_NUM_BUCKETS - 1; // clamped
+
+    int exponent = 63 - __builtin_clzll(value); // >= LATENCY_SUB_BUCKET_BITS
+    int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (int) (value >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+// largest value falling into the bucket
+static uint64_t bucket_value(int index)
+{
+    if (index < LATENCY_SUB_BUCKETS) return (uint64_t) index;
+
+    int shift = index / LATENCY_SUB_BUCKETS - 1;
+    uint64_t lowest = (uint64_t) (index % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS) << shift;
+    return lowest + (1ull << shift) - 1;
+}
+
+void latency_record(struct LatencyHistogram* histogram, int64_t latency_us)
+{
+    if (latency_us < 0) return;
+
+    _Atomic uint64_t* count = &histogram->counts[bucket_index((uint64_t) latency_us)];
+    atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+    if ((uint64_t) latency_us > atomic_load_explicit(&histogram->max_us, memory_order_relaxed))
+        atomic_store_explicit(&histogram->max_us, (uint64_t) latency_us, memory_order_relaxed);
+}
+
+void latency_snapshot(struct LatencyHistogram* histogram, struct LatencySnapshot* snapshot)
+{
+    snapshot->total = 0;
+    for (int i = 0; i < LATENCY_NUM_BUCKETS; i++)
+    {
+        snapshot->counts[i] = atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        snapshot->total += snapshot->counts[i];
+    }
+    snapshot->max_us = atomic_load_explicit(&histogram->max_us, memory_order_relaxed);
+}
+
+void latency_subtract(struct LatencySnapshot* since, const struct LatencySnapshot* before)
+{
+    uint64_t max_bucket_value = 0;
+    since->total = 0;
+    for (int i = 0; i < LATENCY_NUM_BUCKETS; i++)
+    {
+        since->counts[i] -= before->counts[i];
+        since->total += since->counts[i];
+        if (since->counts[i] > 0)
+            max_bucket_value = bucket_value(i) < since->max_us ? bucket_value(i) : since->max_us;
+    }
+    since->max_us = max_bucket_value;
+}
+
+uint64_t latency_percentile(const struct LatencySnapshot* snapshot, double p)
+{
+    if (snapshot->total == 0) return 0;
+
+    uint64_t rank = (uint64_t) (p * snapshot->total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_NUM_BUCKETS; i++)
+    {
+        seen += snapshot->counts[i];
+        if (seen >= rank)
+            return bucket_value(i) < snapshot->max_us ? bucket_value(i) : snapshot->max_us;
+    }
+    return snapshot->max_us;
+}
+
+void latency_write_json(FILE* file, const struct LatencySnapshot* snapshot)
+{
+    fprintf(file, "{\"count\":%llu,\"p50_us\":%llu,\"p99_us\":%llu,\"max_us\":%llu}",
+            (unsigned long long) snapshot->total,
+            (unsigned long long) latency_percentile(snapshot, 0.50),
+            (unsigned long long) latency_percentile(snapshot, 0.99),
+            (unsigned long long) snapshot->max_us);
+}
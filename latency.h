@@ -0,0 +1,39 @@
+// latency histograms in the style of HdrHistogram: log-linear buckets, 32 per power of two, so any recorded
+// value is known to within ~3% over the whole range (1 us to an hour) with a fixed 7 KB table.
+// one thread records into a histogram, any other thread may read it at the same time. Recording is a few
+// shifts and a relaxed store, no locked instructions.
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_NUM_BUCKETS ((32 - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS) // values up to 2^32 us
+
+struct LatencyHistogram {
+    _Atomic uint64_t counts[LATENCY_NUM_BUCKETS];
+    _Atomic uint64_t max_us;
+};
+
+// a copy of a histogram, for reading percentiles and the difference between two points in time
+struct LatencySnapshot {
+    uint64_t counts[LATENCY_NUM_BUCKETS];
+    uint64_t total;
+    uint64_t max_us; // after latency_subtract() only as exact as the buckets
+};
+
+// by the single writer. Negative values are ignored
+void latency_record(struct LatencyHistogram* histogram, int64_t latency_us);
+void latency_snapshot(struct LatencyHistogram* histogram, struct LatencySnapshot* snapshot);
+// what was recorded between the two snapshots, into since
+void latency_subtract(struct LatencySnapshot* since, const struct LatencySnapshot* before);
+// the value p (0..1) of the recorded values are at or below, 0 if there are none
+uint64_t latency_percentile(const struct LatencySnapshot* snapshot, double p);
+// {"count":..,"p50_us":..,"p99_us":..,"max_us":..}
+void latency_write_json(FILE* file, const struct LatencySnapshot* snapshot);
+
+#endif // LATENCY_H
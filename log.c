@@ -0,0 +1,513 @@
+// logging, see log.h
+
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+#define LOG_RING_SLOTS 1024 // power of two
+#define LOG_SLOT_ARGS_SIZE 232
+#define LOG_KNOWN_FORMATS 1024 // power of two
+
+enum LengthModifier
+{
+    LENGTH_DEFAULT, // also h and hh, they are promoted to int anyway
+    LENGTH_LONG,
+    LENGTH_LONG_LONG,
+    LENGTH_SIZE,
+    LENGTH_INTMAX
+};
+
+// one parsed printf conversion, e.g. "%-8.3lu"
+struct Conversion {
+    const char* start; // the '%'
+    const char* end; // behind the conversion character
+    size_t prefix_len; // '%', flags, width and precision: everything before the length modifier
+    enum LengthModifier length;
+    char conversion;
+};
+
+// a message waiting for the writer thread. sequence tells whether the slot is free or filled (bounded MPMC queue by D. Vyukov).
+struct LogSlot {
+    _Atomic uint64_t sequence;
+    enum LogLevel level;
+    const char* fmt;
+    uint64_t time_ns;
+    uint16_t args_size;
+    unsigned char args[LOG_SLOT_ARGS_SIZE];
+};
+
+enum LogLevel log_level = LOG_INFO;
+
+static struct LogSlot slots[LOG_RING_SLOTS];
+static _Atomic uint64_t enqueue_pos __attribute__((aligned(64)));
+static uint64_t dequeue_pos __attribute__((aligned(64))); // only touched by the writer thread
+static _Atomic unsigned long dropped_messages;
+
+static _Atomic int is_writer_running;
+static _Atomic int is_writer_sleeping;
+static _Atomic int is_writer_stopping;
+static int wakeup_fd = -1;
+static pthread_t writer_thread;
+static FILE* binary_out; // NULL: text output
+
+// format ids already written to binary_out, only touched by the writer thread
+static uint64_t known_formats[LOG_KNOWN_FORMATS];
+
+// finds the next conversion in a printf format string, skipping "%%". '*' widths are not supported.
+// returns 0 if there is none
+static int next_conversion(const char* fmt, struct Conversion* conv)
+{
+    const char* p = fmt;
+    while ((p = strchr(p, '%')) != NULL)
+    {
+        if (p[1] == '%')
+        {
+            p += 2;
+            continue;
+        }
+
+        conv->start = p++;
+        while (*p && strchr("-+ #0", *p)) p++;
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p == '.')
+        {
+            p++;
+            while (*p >= '0' && *p <= '9') p++;
+        }
+        conv->prefix_len = (size_t) (p - conv->start);
+
+        conv->length = LENGTH_DEFAULT;
+        if (*p == 'h')
+        {
+            p += p[1] == 'h' ? 2 : 1;
+        }
+        else if (*p == 'l')
+        {
+            conv->length = p[1] == 'l' ? LENGTH_LONG_LONG : LENGTH_LONG;
+            p += p[1] == 'l' ? 2 : 1;
+        }
+        else if (*p == 'z')
+        {
+            conv->length = LENGTH_SIZE;
+            p++;
+        }
+        else if (*p == 'j')
+        {
+            conv->length = LENGTH_INTMAX;
+            p++;
+        }
+        else if (*p == 'L')
+        {
+            p++; // long double is not supported, read as double
+        }
+
+        if (*p == '\0') return 0;
+        conv->conversion = *p++;
+        conv->end = p;
+        return 1;
+    }
+    return 0;
+}
+
+static enum LogArgType arg_type_of(char conversion)
+{
+    switch (conversion)
+    {
+    case 'd': case 'i': case 'c':
+        return LOG_ARG_INT;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        return LOG_ARG_DOUBLE;
+    case 's':
+        return LOG_ARG_STRING;
+    default: // u, x, X, o, p
+        return LOG_ARG_UINT;
+    }
+}
+
+// copies the arguments of a message into buf. Arguments that don't fit are left out.
+static uint16_t encode_args(unsigned char* buf, size_t size, const char* fmt, va_list args)
+{
+    unsigned char* p = buf;
+    unsigned char* end = buf + size;
+    struct Conversion conv;
+    while (next_conversion(fmt, &conv))
+    {
+        fmt = conv.end;
+        enum LogArgType type = arg_type_of(conv.conversion);
+        if (end - p < 1 + 8) break;
+        *p++ = (unsigned char) type;
+        switch (type)
+        {
+        case LOG_ARG_INT:
+        {
+            int64_t v;
+            switch (conv.length)
+            {
+            case LENGTH_LONG: v = va_arg(args, long); break;
+            case LENGTH_LONG_LONG: v = va_arg(args, long long); break;
+            case LENGTH_SIZE: v = (int64_t) va_arg(args, size_t); break;
+            case LENGTH_INTMAX: v = va_arg(args, intmax_t); break;
+            default: v = va_arg(args, int); break;
+            }
+            memcpy(p, &v, sizeof(v));
+            p += sizeof(v);
+            break;
+        }
+        case LOG_ARG_UINT:
+        {
+            uint64_t v;
+            if (conv.conversion == 'p')
+                v = (uint64_t) (uintptr_t) va_arg(args, void*);
+            else switch (conv.length)
+            {
+            case LENGTH_LONG: v = va_arg(args, unsigned long); break;
+            case LENGTH_LONG_LONG: v = va_arg(args, unsigned long long); break;
+            case LENGTH_SIZE: v = va_arg(args, size_t); break;
+            case LENGTH_INTMAX: v = va_arg(args, uintmax_t); break;
+            default: v = va_arg(args, unsigned int); break;
+            }
+            memcpy(p, &v, sizeof(v));
+            p += sizeof(v);
+            break;
+        }
+        case LOG_ARG_DOUBLE:
+        {
+            double v = va_arg(args, double);
+            memcpy(p, &v, sizeof(v));
+            p += sizeof(v);
+            break;
+        }
+        case LOG_ARG_STRING:
+        {
+            const char* s = va_arg(args, const char*);
+            if (s == NULL) s = "(null)";
+            size_t len = strlen(s);
+            size_t room = (size_t) (end - p) - sizeof(uint16_t);
+            uint16_t stored_len = (uint16_t) (len < room ? len : room);
+            memcpy(p, &stored_len, sizeof(stored_len));
+            p += sizeof(stored_len);
+            memcpy(p, s, stored_len);
+            p += stored_len;
+            break;
+        }
+        }
+    }
+    return (uint16_t) (p - buf);
+}
+
+int log_print_encoded(FILE* out, const char* fmt, const unsigned char* args, size_t args_size)
+{
+    const unsigned char* p = args;
+    const unsigned char* end = args + args_size;
+    struct Conversion conv;
+    while (next_conversion(fmt, &conv))
+    {
+        // literal text before the conversion, "%%" is still in there
+        for (const char* c = fmt; c < conv.start; c++)
+        {
+            fputc(*c, out);
+            if (c[0] == '%' && c[1] == '%') c++;
+        }
+        fmt = conv.end;
+
+        if (end - p < 1)
+        {
+            fputs("<truncated>\n", out);
+            return 0;
+        }
+        enum LogArgType type = (enum LogArgType) *p++;
+
+        // the flags, width and precision of the original, with the length modifier of the stored type
+        char spec[32];
+        size_t prefix_len = conv.prefix_len < sizeof(spec) - 4 ? conv.prefix_len : sizeof(spec) - 4;
+        memcpy(spec, conv.start, prefix_len);
+        char* s = spec + prefix_len;
+
+        if (type == LOG_ARG_STRING)
+        {
+            uint16_t len;
+            if ((size_t) (end - p) < sizeof(len)) return -1;
+            memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if (end - p < len) return -1;
+            char str[LOG_SLOT_ARGS_SIZE + 1];
+            size_t n = len < LOG_SLOT_ARGS_SIZE ? len : LOG_SLOT_ARGS_SIZE;
+            memcpy(str, p, n);
+            str[n] = '\0';
+            p += len;
+            *s++ = 's';
+            *s = '\0';
+            fprintf(out, spec, str);
+            continue;
+        }
+
+        if (end - p < 8) return -1;
+        uint64_t bits;
+        memcpy(&bits, p, sizeof(bits));
+        p += sizeof(bits);
+        if (type == LOG_ARG_DOUBLE)
+        {
+            double v;
+            memcpy(&v, &bits, sizeof(v));
+            *s++ = conv.conversion;
+            *s = '\0';
+            fprintf(out, spec, v);
+        }
+        else if (conv.conversion == 'c')
+        {
+            *s++ = 'c';
+            *s = '\0';
+            fprintf(out, spec, (int) bits);
+        }
+        else if (conv.conversion == 'p')
+        {
+            *s++ = 'p';
+            *s = '\0';
+            fprintf(out, spec, (void*) (uintptr_t) bits);
+        }
+        else
+        {
+            *s++ = 'l';
+            *s++ = 'l';
+            *s++ = conv.conversion;
+            *s = '\0';
+            if (type == LOG_ARG_INT)
+                fprintf(out, spec, (long long) (int64_t) bits);
+            else
+                fprintf(out, spec, (unsigned long long) bits);
+        }
+    }
+    for (const char* c = fmt; *c; c++)
+    {
+        fputc(*c, out);
+        if (c[0] == '%' && c[1] == '%') c++;
+    }
+    return 0;
+}
+
+static uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static FILE* text_stream_for(enum LogLevel level)
+{
+    return level <= LOG_ERROR ? stderr : stdout;
+}
+
+static void write_binary_record(struct LogSlot* slot)
+{
+    uint64_t format_id = (uint64_t) (uintptr_t) slot->fmt;
+
+    // write the format string the first time it is used. If the table is full it is just repeated.
+    size_t i = (size_t) (format_id >> 3) & (LOG_KNOWN_FORMATS - 1);
+    for (size_t probes = 0; probes < LOG_KNOWN_FORMATS; probes++, i = (i + 1) & (LOG_KNOWN_FORMATS - 1))
+    {
+        if (known_formats[i] == format_id)
+            break;
+        if (known_formats[i] == 0 || probes == LOG_KNOWN_FORMATS - 1)
+        {
+            if (known_formats[i] == 0)
+                known_formats[i] = format_id;
+            size_t len = strlen(slot->fmt);
+            if (len > UINT16_MAX - sizeof(format_id))
+                len = UINT16_MAX - sizeof(format_id);
+            struct LogRecordHeader header = { .type = LOG_RECORD_FORMAT, .level = 0, .size = (uint16_t) (sizeof(format_id) + len) };
+            fwrite(&header, sizeof(header), 1, binary_out);
+            fwrite(&format_id, sizeof(format_id), 1, binary_out);
+            fwrite(slot->fmt, 1, len, binary_out);
+            break;
+        }
+    }
+
+    struct LogRecordHeader header =
+    {
+        .type = LOG_RECORD_MESSAGE,
+        .level = (uint8_t) slot->level,
+        .size = (uint16_t) (sizeof(format_id) + sizeof(slot->time_ns) + slot->args_size),
+    };
+    fwrite(&header, sizeof(header), 1, binary_out);
+    fwrite(&format_id, sizeof(format_id), 1, binary_out);
+    fwrite(&slot->time_ns, sizeof(slot->time_ns), 1, binary_out);
+    fwrite(slot->args, 1, slot->args_size, binary_out);
+}
+
+static void write_slot(struct LogSlot* slot)
+{
+    if (binary_out != NULL)
+        write_binary_record(slot);
+    else
+        log_print_encoded(text_stream_for(slot->level), slot->fmt, slot->args, slot->args_size);
+}
+
+static int is_ring_empty()
+{
+    struct LogSlot* slot = &slots[dequeue_pos & (LOG_RING_SLOTS - 1)];
+    return atomic_load_explicit(&slot->sequence, memory_order_acquire) != dequeue_pos + 1;
+}
+
+// writes out all queued messages, returns the number written
+static unsigned long drain_ring()
+{
+    unsigned long written = 0;
+    while (!is_ring_empty())
+    {
+        struct LogSlot* slot = &slots[dequeue_pos & (LOG_RING_SLOTS - 1)];
+        write_slot(slot);
+        atomic_store_explicit(&slot->sequence, dequeue_pos + LOG_RING_SLOTS, memory_order_release);
+        dequeue_pos++;
+        written++;
+    }
+    return written;
+}
+
+static void* run_log_writer(void* arg)
+{
+    (void) arg;
+    while (1)
+    {
+        if (drain_ring() > 0)
+        {
+            if (binary_out != NULL)
+                fflush(binary_out);
+            fflush(stdout);
+        }
+        if (atomic_load(&is_writer_stopping) && is_ring_empty())
+            break;
+
+        // announce going to sleep before the last look at the ring, a producer that misses it wakes us up
+        atomic_store(&is_writer_sleeping, 1);
+        if (!is_ring_empty() || atomic_load(&is_writer_stopping))
+        {
+            atomic_store(&is_writer_sleeping, 0);
+            continue;
+        }
+        uint64_t kicks;
+        if (read(wakeup_fd, &kicks, sizeof(kicks)) == -1 && errno != EINTR)
+        {
+            fprintf(stderr, "log writer failed to wait for messages: %s\n", strerror(errno));
+            break;
+        }
+        atomic_store(&is_writer_sleeping, 0);
+    }
+    return NULL;
+}
+
+static void wake_writer()
+{
+    uint64_t one = 1;
+    if (write(wakeup_fd, &one, sizeof(one)) != sizeof(one))
+        fprintf(stderr, "failed to wake up log writer: %s\n", strerror(errno));
+}
+
+void log_message(enum LogLevel level, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    if (level <= LOG_ERROR || !atomic_load_explicit(&is_writer_running, memory_order_acquire))
+    {
+        vfprintf(text_stream_for(level), fmt, args);
+        va_end(args);
+        return;
+    }
+
+    // claim a slot
+    uint64_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    struct LogSlot* slot;
+    while (1)
+    {
+        slot = &slots[pos & (LOG_RING_SLOTS - 1)];
+        int64_t diff = (int64_t) (atomic_load_explicit(&slot->sequence, memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // full, the writer can't keep up. Rather lose the message than wait.
+            atomic_fetch_add_explicit(&dropped_messages, 1, memory_order_relaxed);
+            va_end(args);
+            return;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->fmt = fmt;
+    slot->time_ns = binary_out != NULL ? monotonic_ns() : 0;
+    slot->args_size = encode_args(slot->args, sizeof(slot->args), fmt, args);
+    va_end(args);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&is_writer_sleeping, memory_order_relaxed)
+            && atomic_exchange(&is_writer_sleeping, 0))
+        wake_writer();
+}
+
+int log_start(const char* binary_log_path)
+{
+    for (uint64_t i = 0; i < LOG_RING_SLOTS; i++)
+        atomic_init(&slots[i].sequence, i);
+
+    if (binary_log_path != NULL)
+    {
+        binary_out = fopen(binary_log_path, "wb");
+        if (binary_out == NULL)
+        {
+            fprintf(stderr, "failed to open log file %s: %s\n", binary_log_path, strerror(errno));
+            return -1;
+        }
+        fwrite(LOG_BINARY_MAGIC, 1, LOG_BINARY_MAGIC_LEN, binary_out);
+    }
+
+    wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd == -1)
+    {
+        fprintf(stderr, "failed to create eventfd for the log writer: %s\n", strerror(errno));
+        return -1;
+    }
+    int rc = pthread_create(&writer_thread, NULL, run_log_writer, NULL);
+    if (rc != 0)
+    {
+        fprintf(stderr, "failed to start log writer thread: %s\n", strerror(rc));
+        return -1;
+    }
+    atomic_store_explicit(&is_writer_running, 1, memory_order_release);
+    atexit(log_stop);
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (!atomic_exchange(&is_writer_running, 0)) return;
+
+    atomic_store(&is_writer_stopping, 1);
+    wake_writer();
+    pthread_join(writer_thread, NULL);
+    if (binary_out != NULL)
+        fclose(binary_out);
+    binary_out = NULL;
+    fflush(stdout);
+}
+
+unsigned long log_dropped_messages(void)
+{
+    return atomic_load_explicit(&dropped_messages, memory_order_relaxed);
+}
@@ -0,0 +1,75 @@
+// logging for the event loop and its threads
+// a disabled level costs one comparison at the call site (the arguments are not even evaluated).
+// enabled messages are copied into an in-memory ring buffer, a background thread formats and writes them out,
+// so a slow or blocked stdout never stalls input handling. Errors are written synchronously.
+// with log_start(path) the messages are written as compact binary records instead, decode them with
+// MouseMoveToScrollLogDecode.
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+enum LogLevel
+{
+    LOG_OFF,
+    LOG_FATAL,
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+};
+
+// levels above this are compiled out, e.g. -DLOG_MAX_LEVEL=LOG_INFO
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_DEBUG
+#endif
+
+extern enum LogLevel log_level;
+
+#define logg(level, ...) \
+    do { if ((level) <= LOG_MAX_LEVEL && (level) <= log_level) log_message((level), __VA_ARGS__); } while (0)
+
+void log_message(enum LogLevel level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// starts the writer thread. binary_log_path NULL: text to stdout (errors to stderr), else binary records to that file.
+// returns 0 on success. Until then messages are written synchronously.
+int log_start(const char* binary_log_path);
+// writes out everything queued and stops the writer thread, registered with atexit() by log_start()
+void log_stop(void);
+unsigned long log_dropped_messages(void);
+
+// binary log file: LOG_BINARY_MAGIC, then records. Host byte order, the file is read back on the same machine.
+// every record starts with a struct LogRecordHeader followed by `size` bytes:
+//  LOG_RECORD_FORMAT:  uint64 format id, format string (not terminated). Comes before the first message using it.
+//  LOG_RECORD_MESSAGE: uint64 format id, uint64 CLOCK_MONOTONIC ns, arguments.
+// every argument is a one byte enum LogArgType followed by int64 / uint64 / double, or for strings uint16 length and the bytes.
+#define LOG_BINARY_MAGIC "MMTSLOG1"
+#define LOG_BINARY_MAGIC_LEN 8
+
+enum LogRecordType
+{
+    LOG_RECORD_FORMAT = 1,
+    LOG_RECORD_MESSAGE = 2
+};
+
+struct LogRecordHeader {
+    uint8_t type; // enum LogRecordType
+    uint8_t level; // enum LogLevel, messages only
+    uint16_t size;
+};
+
+enum LogArgType
+{
+    LOG_ARG_INT = 'i',
+    LOG_ARG_UINT = 'u',
+    LOG_ARG_DOUBLE = 'd',
+    LOG_ARG_STRING = 's'
+};
+
+// prints a message from its format string and encoded arguments (see LOG_RECORD_MESSAGE), returns -1 on malformed arguments
+int log_print_encoded(FILE* out, const char* fmt, const unsigned char* args, size_t args_size);
+
+#endif // LOG_H
@@ -0,0 +1,126 @@
+// prints a binary log written by MouseMoveToScroll -L as text, one line per message prefixed with its
+// CLOCK_MONOTONIC time and level
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "log.h"
+
+#define MAX_FORMATS 4096
+
+struct Format {
+    uint64_t id;
+    char* fmt;
+};
+
+static struct Format formats[MAX_FORMATS];
+static int num_formats = 0;
+
+static const char* find_format(uint64_t id)
+{
+    // later definitions win, the writer repeats a format when its table is full
+    for (int i = num_formats - 1; i >= 0; i--)
+    {
+        if (formats[i].id == id)
+            return formats[i].fmt;
+    }
+    return NULL;
+}
+
+static const char* level_name(uint8_t level)
+{
+    switch (level)
+    {
+    case LOG_FATAL: return "FATAL";
+    case LOG_ERROR: return "ERROR";
+    case LOG_WARN: return "WARN";
+    case LOG_INFO: return "INFO";
+    case LOG_DEBUG: return "DEBUG";
+    default: return "?";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 || strcmp(argv[1], "-h") == 0)
+    {
+        fprintf(stderr, "usage: %s [binary log file]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    char magic[LOG_BINARY_MAGIC_LEN];
+    if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, LOG_BINARY_MAGIC, sizeof(magic)) != 0)
+    {
+        fprintf(stderr, "%s is not a binary MouseMoveToScroll log\n", argv[1]);
+        return 1;
+    }
+
+    unsigned long num_messages = 0;
+    struct LogRecordHeader header;
+    unsigned char payload[UINT16_MAX + 1];
+    while (fread(&header, sizeof(header), 1, in) == 1)
+    {
+        if (fread(payload, 1, header.size, in) != header.size)
+        {
+            fprintf(stderr, "truncated record at the end of the log\n");
+            break;
+        }
+
+        uint64_t format_id;
+        if (header.size < sizeof(format_id))
+        {
+            fprintf(stderr, "malformed record\n");
+            return 1;
+        }
+        memcpy(&format_id, payload, sizeof(format_id));
+
+        if (header.type == LOG_RECORD_FORMAT)
+        {
+            if (num_formats == MAX_FORMATS)
+            {
+                fprintf(stderr, "too many format strings\n");
+                return 1;
+            }
+            size_t len = header.size - sizeof(format_id);
+            formats[num_formats].id = format_id;
+            formats[num_formats].fmt = malloc(len + 1);
+            memcpy(formats[num_formats].fmt, payload + sizeof(format_id), len);
+            formats[num_formats].fmt[len] = '\0';
+            num_formats++;
+        }
+        else if (header.type == LOG_RECORD_MESSAGE)
+        {
+            uint64_t time_ns;
+            if (header.size < sizeof(format_id) + sizeof(time_ns))
+            {
+                fprintf(stderr, "malformed record\n");
+                return 1;
+            }
+            memcpy(&time_ns, payload + sizeof(format_id), sizeof(time_ns));
+
+            const char* fmt = find_format(format_id);
+            printf("%llu.%06llu %-5s ", (unsigned long long) (time_ns / 1000000000u),
+                   (unsigned long long) (time_ns % 1000000000u / 1000), level_name(header.level));
+            if (fmt == NULL)
+            {
+                printf("<unknown format %llx>\n", (unsigned long long) format_id);
+                continue;
+            }
+            size_t args_offset = sizeof(format_id) + sizeof(time_ns);
+            if (log_print_encoded(stdout, fmt, payload + args_offset, header.size - args_offset) != 0)
+                printf("<malformed arguments>\n");
+            num_messages++;
+        }
+    }
+
+    fprintf(stderr, "%lu messages\n", num_messages);
+    return 0;
+}
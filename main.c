@@ -10,79 +10,296 @@
 #include <inttypes.h>
 #include <errno.h>
 #include <stdint.h>
+#include <limits.h>
 #include <getopt.h>
 #include <sys/file.h>
-#include <stdarg.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <X11/Xlib.h>
+#include <X11/Xlibint.h>
 #include <X11/extensions/XInput2.h>
-#include <X11/extensions/XTest.h>
 #include <X11/extensions/Xfixes.h>
+#include <X11/extensions/scrnsaver.h>
+#ifdef USE_XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xinput.h>
+#include <xcb/screensaver.h>
+#endif
+#include "log.h"
+#include "timers.h"
+#include "scrollcore.h"
+#include "kinetics.h"
+#include "emitqueue.h"
+#include "output.h"
+#include "evdev.h"
+#include "trace.h"
+#include "flightrec.h"
+#include "latency.h"
+#include "statspage.h"
+#include "probes.h"
+#include "devices.h"
+#include "accel.h"
 
-enum LogLevel
-{
-    LOG_OFF,
-    LOG_FATAL,
-    LOG_ERROR,
-    LOG_WARN,
-    LOG_INFO,
-    LOG_DEBUG,
-};
-
-enum ScrollDirection
-{
-    SCROLL_HORIZONTAL = 1,
-    SCROLL_VERTICAL = 2
+struct ScreenPoint {
+    int x;
+    int y;
 };
 
-enum ScrollDirectionLinuxButtons
+// how the pointer is kept in place while scrolling
+enum PointerFixation
 {
-    SCROLL_UP = 4,
-    SCROLL_DOWN = 5,
-    SCROLL_LEFT = 6,
-    SCROLL_RIGHT = 7
+    FIXATE_BY_BARRIERS, // confine the pointer with XFixes pointer barriers once per activation
+    FIXATE_BY_WARPING,  // warp the pointer back after every move
+    FIXATE_BY_GRABBING  // grab the evdev pointer devices exclusively, their motion doesn't reach X then
 };
 
-struct ScreenPoint {
-    int x;
-    int y;
+#define MAX_POINTER_DEVICES 8
+#define MAX_DEVICE_PROFILES 8
+#define MAX_EVDEV_DEVICES 8
+#define EMIT_QUEUE_KEY_SLOTS 1 // kept free of scrolls, so a key release still fits when scrolling filled the queue
+#define MAX_RAW_MOTION_SOURCES 16
+#define MAX_EVENT_AGE_US (10 * 1000000LL) // older event stamps are taken to be from another clock
+
+// options of one pointer device, instead of the global ones
+struct DeviceProfile {
+    const char* device_name;
+    double threshold; // like -c, in mm with -m
+    Bool allow_horizontal_scroll;
+    Bool allow_triggering_of_repeated_scroll_event;
 };
 
 struct Config {
     uint mouse_move_delta_to_scroll_threshold;
+    double scroll_threshold_mm; // travel per click of devices that report their resolution, in units of -c then. 0: off
+    double scroll_rate_limit; // clicks per second and axis
+    uint scroll_burst;
+    double kinetic_time_constant_ms; // momentum scrolling: velocity decays by 1/e in this time, 0: off
+    double kinetic_friction; // momentum scrolling: constant deceleration in counts/s²
+    const char* pointer_device_names[MAX_POINTER_DEVICES];
+    int num_pointer_device_names;
+    const char* evdev_device_paths[MAX_EVDEV_DEVICES]; // read input from these instead of XInput2
+    int num_evdev_device_paths;
     Bool allow_horizontal_scroll;
     Bool allow_triggering_of_repeated_scroll_event;
     Bool show_debug_output;
+    Bool show_stats;
     Bool is_toggle_mode_on;
     Bool release_trigger_button;
+    enum PointerFixation pointer_fixation;
+    enum OutputBackendType output_type;
     int trigger_key_code;
     int trigger_key_modifiers;
+    const char* binary_log_path; // NULL: log as text to stdout
+    const char* record_path; // write the input to this trace
+    const char* replay_path; // feed this trace through the conversion instead of reading input
+    Bool replay_in_real_time; // else as fast as possible
+    int flight_recorder_s; // keep this much of the recent motion and decisions for a dump, 0: off
+    const char* latency_json_path; // append the latency histograms to this file as JSON lines, "-": stdout
+    struct DeviceProfile device_profiles[MAX_DEVICE_PROFILES];
+    int num_device_profiles;
+    const char* accel_curve_spec; // velocity dependent gain, see accel.h. NULL: linear
+    struct AccelCurve accel_curve;
 };
 
 static const char* PROGRAM_VERSION = "1.0";
 static const int NANOSECOND_TO_MILLISECOND_DIV = 1000000;
-static const int SCROLL_TRIGGER_SPEED_LIMIT_MS = 30; // don't allow scrolling in too quick succession, it can't handle them so fast, so they queue up an play back, also causing more CPU load
+static const double DEFAULT_SCROLL_RATE_LIMIT = 1000.0 / 30; // clicks per second per axis. Don't allow scrolling in too quick succession, it can't handle them so fast, so they queue up an play back, also causing more CPU load
+static const uint DEFAULT_SCROLL_BURST = 3; // clicks that may be sent at once after a pause
+static const int KINETIC_TICK_MS = 16; // momentum scrolling step, about one per frame
+static const int KINETIC_MOTION_STOP_MS = 40; // no motion for this long: the ball/pointer was released
+static const double KINETIC_MIN_START_CLICKS_PER_S = 5; // slower releases just stop
+static const double KINETIC_MIN_CLICKS_PER_S = 1; // momentum stops below this
+static const int SCROLL_BACKLOG_LIMIT_MS = 500; // movement held back by the rate limit beyond this much scrolling time is discarded
 static const int UNSPECIFIED_KEY_CODE = -1;
+static const int STATS_REPORT_INTERVAL_MS = 1000;
+static const int64_t STATS_REPORT_SLACK_NS = 250 * 1000000LL; // report late rather than wake up just for it
+static const int64_t BACKLOG_RELEASE_SLACK_NS = 2 * 1000000LL;
+static const int DEFAULT_FLIGHT_RECORDER_S = 10;
+static const char* FLIGHT_RECORDER_DUMP_NAME = "MouseMoveToScroll.flight"; // in $XDG_RUNTIME_DIR, else /tmp
+
+// last report seen per source (slave) device, to recognize the master's copy of it
+struct RawMotionSource {
+    int source_id;
+    int device_id; // device the report was first seen from
+    Time time;
+};
+
+// which pointer devices raw motion is selected for
+struct DeviceSelection {
+    Bool use_master_pointers; // no pointer devices configured
+    int pointer_device_ids[MAX_POINTER_DEVICES]; // resolved from Config.pointer_device_names, empty: all master pointers
+    int num_pointer_device_ids;
+    int selected_device_ids[MAX_POINTER_DEVICES]; // currently selected for raw motion individually
+    int num_selected_device_ids;
+    struct RawMotionSource sources[MAX_RAW_MOTION_SOURCES];
+};
+
 
-static int is_active = False;
-static int scrolls_since_active = 0;
-static enum LogLevel log_level = LOG_INFO;
-static struct timespec last_scroll_time;
+// raw motion collected while draining the event queue, summed per source device and axis
+struct MotionBatchDevice {
+    int source_id;
+    double delta_x;
+    double delta_y;
+};
+
+struct MotionBatch {
+    struct MotionBatchDevice devices[MAX_POINTER_DEVICES];
+    int num_devices;
+    unsigned long num_events;
+    EventTime time; // of the latest report
+    int64_t first_report_us; // CLOCK_MONOTONIC of the oldest report, for the latency
+};
 
-void logg(enum LogLevel level, const char* fmt, ...)
+// what woke up epoll_wait
+enum EventSource
 {
-    va_list args;
-    va_start(args, fmt);
-    if ((level == LOG_ERROR && log_level >= LOG_ERROR) || (level == LOG_FATAL && log_level >= LOG_FATAL))
-    {
-        vfprintf(stderr, fmt, args);
-    }
-    else if (log_level >= level)
-    {
-        vfprintf(stdout, fmt, args);
-    }
-    va_end(args);
-}
+    SOURCE_X,
+    SOURCE_TIMERS,
+    SOURCE_SIGNALS,
+    SOURCE_EVDEV
+};
+
+// state of the main loop shared by the event handlers
+struct EventLoop {
+    int epoll_fd;
+    int signal_fd;
+    struct TimerSet timers;
+    struct Timer backlog_timer; // scrolls movement held back by the pacers
+    struct Timer stats_timer;
+    struct Timer motion_stop_timer; // notices the end of motion, for kinetic scrolling
+    struct Timer kinetic_timer; // steps the momentum
+    struct Kinetics kinetics;
+    Bool is_evdev_readable; // one of the evdev devices woke up epoll, to be drained by the caller
+    Bool has_reported_stats; // the stats timer ran in this wakeup
+    Display* display; // NULL when running without X (evdev input and output)
+#ifdef USE_XCB
+    xcb_connection_t* connection; // of display, XCB owns its event queue
+    xcb_generic_event_t* queued_event; // taken from the queue by has_queued_x_events(), to be handled next
+#endif
+    Window window;
+    struct Config* cfg;
+    int xi_opcode;
+    int screen_saver_event_base;
+    int xtest_keyboard_device_id;
+    struct ScreenPoint start_pointer_pos;
+    // root position of the master pointer, as of the latest XI2 key event. Taken for the start position on
+    // activation, the trigger key's own event has it, so no XQueryPointer round trip is needed
+    struct ScreenPoint pointer_pos;
+    Bool is_pointer_pos_known;
+    // timing decisions use the time the server stamped on the event, not when we got to process it.
+    // without an event (held back movement) CLOCK_MONOTONIC plus this offset stands in for it.
+    int64_t event_time_minus_monotonic_ms;
+    struct MotionBatch motion_batch;
+};
+
+// sends the output on its own thread and X connection, so a slow or congested connection
+// doesn't delay reading the next input event
+struct Emitter {
+    Display* display;
+    struct OutputBackend* output;
+    int wakeup_fd; // eventfd, kicked by the event loop once per drain when commands were queued
+    pthread_t thread;
+    // commands are published together once per drain, so the emitter sends all of the drain's output (both
+    // axes, all clicks) with one flush
+    struct EmitQueue queue;
+    unsigned long published_batches;
+    unsigned long dropped_commands; // queue was full, only touched by the event loop
+    unsigned long max_queue_depth;
+    _Atomic unsigned long sent_commands;
+    _Atomic unsigned long writes; // flushes of the emitter connection, i.e. write() calls
+    _Atomic unsigned long bytes_written;
+    struct LatencyHistogram decision_to_flush_latency; // recorded by the emitter thread
+    _Atomic int has_stopped; // the emitter thread is gone, nothing takes commands off the queue anymore
+};
+
+// X protocol traffic of the event loop's connection (the emitter has its own)
+struct XTraffic {
+    unsigned long requests;
+    unsigned long round_trips; // requests whose reply was waited for
+    unsigned long bytes_written;
+};
+
+// what the X traffic is attributed to
+enum XTrafficCause
+{
+    X_CAUSE_RAW_MOTION,
+    X_CAUSE_KEY,
+    X_CAUSE_OTHER_EVENT,
+    X_CAUSE_LOOP, // outside of event handlers, e.g. the warp after a motion batch, flushes
+    NUM_X_CAUSES
+};
+
+// counters for judging the cost of the program, printed with -S
+struct Stats {
+    unsigned long wakeups; // times the event loop had to wait, not counting the report timer's own
+    unsigned long wakeups_since_report;
+    unsigned long raw_motion_events; // as received, including duplicates
+    unsigned long raw_motion_reports; // physical reports, after removing duplicates
+    unsigned long drains; // times the event queue was drained, one per wakeup
+    unsigned long drained_events;
+    unsigned long motion_batches; // scroll decisions made for coalesced motion
+    unsigned long max_motion_batch_size;
+    unsigned long warps;
+    unsigned long kinetic_flicks; // momentum scrolls started
+    unsigned long busy_ns_total; // time spent handling a drain, i.e. how long reading the next input is delayed
+    unsigned long busy_ns_max;
+    unsigned long input_latency_us_total; // from the time stamped on a motion report until it is handled
+    unsigned long input_latency_us_max;
+    unsigned long input_latency_samples;
+    struct LatencyHistogram event_to_decision_latency; // from the time stamped on the oldest report of a motion batch until the scroll is queued
+    int64_t scroll_cause_us; // CLOCK_MONOTONIC of that report while the batch is converted, 0: scrolling without new motion
+    struct LatencyHistogram activation_latency; // from the trigger key press until scrolling mode is set up
+    struct LatencyHistogram activation_to_first_scroll_latency; // from the trigger key press until the first scroll is queued
+    int64_t activation_event_us; // CLOCK_MONOTONIC of the trigger key press until the first scroll, 0: none pending
+    unsigned long x_requests_at_report; // X request serial at the last report
+    struct XTraffic x_traffic_by_cause[NUM_X_CAUSES];
+    unsigned long x_events_by_cause[NUM_X_CAUSES];
+    struct XTraffic x_traffic_at_iteration; // at the start of the current loop iteration
+    struct XTraffic x_event_traffic_in_iteration; // caused by the event handlers in the current iteration
+    unsigned long x_iterations;
+    unsigned long x_max_requests_per_iteration;
+    unsigned long x_round_trip_iterations; // iterations that waited for a reply
+    Bool has_warned_of_motion_round_trip;
+    int64_t cpu_ns_at_report; // process CPU time, for the CPU cost per event
+    unsigned long drained_events_at_report;
+    struct timespec last_report_time;
+};
+
+// latency histograms as of the previous report, the report shows what happened since as well
+struct LatencyReport {
+    FILE* json; // --latency-json, NULL: none
+    struct LatencySnapshot event_to_decision;
+    struct LatencySnapshot decision_to_flush;
+};
+
+static PointerBarrier pointer_barriers[4]; // left, right, top, bottom; 0 if not confined
+
+static int is_screen_saver_on = False;
+static struct Stats stats;
+static struct XTraffic x_traffic; // totals, round trips and bytes counted by the Xlib hooks
+static struct LatencyReport latency_report;
+static struct StatsPage unshared_stats_page; // stands in if the shared one can't be created, and when replaying
+static struct StatsPage* stats_page = &unshared_stats_page; // live counters, read by MouseMoveToScrollStats
+static struct DeviceSelection device_selection;
+static struct EvdevInput evdev_inputs[MAX_EVDEV_DEVICES];
+static int num_evdev_inputs = 0; // > 0: input comes from evdev instead of XInput2
+static struct Emitter emitter;
+static struct ScrollCore scroll_core; // scrolling mode, and the movement of sources without a device of their own (evdev, momentum)
+static struct ScrollCoreConfig scroll_core_cfg; // what the pointer devices' cores start from
+static struct ScrollSink scroll_sink;
+static void (*release_trigger_key)(void* data, unsigned int key_code); // the sink's, scroll_sink releases through it
+static Bool is_trigger_key_released = False; // since the activation, by one of the cores
+static struct ScrollClock scroll_clock;
+static struct DeviceTable input_devices; // XI2 devices, each pointer with its own scroll core
+static struct TraceWriter* recording = NULL; // --record
+static struct FlightRecorder* flight_recorder = NULL; // always on unless --flight-recorder 0
 
 struct Config create_default_config()
 {
@@ -92,10 +309,17 @@ struct Config create_default_config()
                 .allow_horizontal_scroll = False,
                 .allow_triggering_of_repeated_scroll_event = False,
                 .show_debug_output = False,
+                .show_stats = False,
                 .is_toggle_mode_on = False,
                 .release_trigger_button = True,
+                .pointer_fixation = FIXATE_BY_BARRIERS,
+                .output_type = OUTPUT_XTEST,
                 .trigger_key_code = UNSPECIFIED_KEY_CODE,
                 .trigger_key_modifiers = 0,
+                .binary_log_path = NULL,
+                .scroll_rate_limit = DEFAULT_SCROLL_RATE_LIMIT,
+                .scroll_burst = DEFAULT_SCROLL_BURST,
+                .flight_recorder_s = DEFAULT_FLIGHT_RECORDER_S,
     };
     return cfg;
 }
@@ -104,20 +328,103 @@ void print_cfg(struct Config* cfg)
 {
     printf("config:\n");
     printf("mouse_move_delta_to_scroll_threshold %i\n", cfg->mouse_move_delta_to_scroll_threshold);
+    printf("scroll_threshold_mm %g\n", cfg->scroll_threshold_mm);
+    printf("scroll_rate_limit %g\n", cfg->scroll_rate_limit);
+    printf("scroll_burst %u\n", cfg->scroll_burst);
+    printf("kinetic_time_constant_ms %g\n", cfg->kinetic_time_constant_ms);
+    printf("kinetic_friction %g\n", cfg->kinetic_friction);
+    for (int i = 0; i < cfg->num_pointer_device_names; i++)
+        printf("pointer_device_name %s\n", cfg->pointer_device_names[i]);
+    for (int i = 0; i < cfg->num_evdev_device_paths; i++)
+        printf("evdev_device_path %s\n", cfg->evdev_device_paths[i]);
     printf("allow_horizontal_scroll %i\n", cfg->allow_horizontal_scroll);
     printf("allow_triggering_of_repeated_scroll_event %i\n", cfg->allow_triggering_of_repeated_scroll_event);
     printf("show_debug_output %i\n", cfg->show_debug_output);
+    printf("show_stats %i\n", cfg->show_stats);
     printf("is_toggle_mode_on %i\n", cfg->is_toggle_mode_on);
     printf("release_trigger_button %i\n", cfg->release_trigger_button);
+    printf("pointer_fixation %s\n", cfg->pointer_fixation == FIXATE_BY_BARRIERS ? "barriers"
+                                     : cfg->pointer_fixation == FIXATE_BY_WARPING ? "warping" : "grabbing");
+    printf("output %s\n", output_backend_type_name(cfg->output_type));
     printf("trigger_key_code %i\n", cfg->trigger_key_code);
     printf("trigger_key_modifiers %i\n", cfg->trigger_key_modifiers);
+    printf("binary_log_path %s\n", cfg->binary_log_path ? cfg->binary_log_path : "-");
+    printf("record_path %s\n", cfg->record_path ? cfg->record_path : "-");
+    printf("replay_path %s\n", cfg->replay_path ? cfg->replay_path : "-");
+    printf("replay_in_real_time %i\n", cfg->replay_in_real_time);
+    printf("flight_recorder_s %i\n", cfg->flight_recorder_s);
+    printf("latency_json_path %s\n", cfg->latency_json_path ? cfg->latency_json_path : "-");
+    printf("accel_curve %s\n", cfg->accel_curve_spec ? cfg->accel_curve_spec : "-");
+    for (int i = 0; i < cfg->num_device_profiles; i++)
+    {
+        struct DeviceProfile* profile = &cfg->device_profiles[i];
+        printf("profile '%s' threshold %g horizontal %i repeated %i\n", profile->device_name,
+               profile->threshold, profile->allow_horizontal_scroll,
+               profile->allow_triggering_of_repeated_scroll_event);
+    }
+}
+
+// long options without a short one
+enum LongOption
+{
+    OPT_RECORD = 256,
+    OPT_REPLAY,
+    OPT_REAL_TIME,
+    OPT_FLIGHT_RECORDER,
+    OPT_LATENCY_JSON,
+    OPT_PROFILE,
+    OPT_ACCEL
+};
+
+static const struct option LONG_OPTIONS[] =
+{
+    { "record", required_argument, NULL, OPT_RECORD },
+    { "replay", required_argument, NULL, OPT_REPLAY },
+    { "real-time", no_argument, NULL, OPT_REAL_TIME },
+    { "flight-recorder", required_argument, NULL, OPT_FLIGHT_RECORDER },
+    { "latency-json", required_argument, NULL, OPT_LATENCY_JSON },
+    { "profile", required_argument, NULL, OPT_PROFILE },
+    { "accel", required_argument, NULL, OPT_ACCEL },
+    { NULL, 0, NULL, 0 }
+};
+
+// "device name=threshold[,h][,r]", h: allow horizontal scrolling, r: repeated scroll events
+static void parse_device_profile(char* arg, struct Config* cfg)
+{
+    char* options = strrchr(arg, '=');
+    if (options == NULL || options == arg || cfg->num_device_profiles == MAX_DEVICE_PROFILES)
+    {
+        logg(LOG_FATAL, "error parsing --profile %s. It must be 'device name=threshold[,h][,r]', at most %d times.\n", arg, MAX_DEVICE_PROFILES);
+        exit(-1);
+    }
+    *options++ = '\0';
+
+    struct DeviceProfile profile = { .device_name = arg };
+    char* end;
+    double threshold = strtod(options, &end);
+    for (char* option = strtok(end, ","); option != NULL; option = strtok(NULL, ","))
+    {
+        if (strcmp(option, "h") == 0)
+            profile.allow_horizontal_scroll = True;
+        else if (strcmp(option, "r") == 0)
+            profile.allow_triggering_of_repeated_scroll_event = True;
+        else
+            threshold = 0;
+    }
+    if (end == options || threshold <= 0)
+    {
+        logg(LOG_FATAL, "error parsing --profile %s=%s. It must be 'device name=threshold[,h][,r]' with a positive threshold.\n", arg, options);
+        exit(-1);
+    }
+    profile.threshold = threshold;
+    cfg->device_profiles[cfg->num_device_profiles++] = profile;
 }
 
 void parse_args_into_config(int argc, char** argv, struct Config* cfg) {
     char *cvalue = NULL;
     int c;
     if (argc > 1) {
-        while ((c = getopt (argc, argv, "HtdRrhvc:s:")) != -1)
+        while ((c = getopt_long (argc, argv, "HtdSRrhvwc:m:s:p:l:b:L:k:K:o:e:", LONG_OPTIONS, NULL)) != -1)
             switch (c)
             {
             case 'c':
@@ -132,6 +439,57 @@ void parse_args_into_config(int argc, char** argv, struct Config* cfg) {
                 cfg->mouse_move_delta_to_scroll_threshold = (uint) labs(num);
                 break;
             }
+            case 'm':
+            {
+                char* end;
+                double mm = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || mm <= 0)
+                {
+                    logg(LOG_FATAL, "error parsing value for -%c. It must be a positive number.", c);
+                    exit(-1);
+                }
+                cfg->scroll_threshold_mm = mm;
+                break;
+            }
+            case 'l':
+            {
+                char* end;
+                double rate = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || rate <= 0)
+                {
+                    logg(LOG_FATAL, "error parsing value for -%c. It must be a positive number.", c);
+                    exit(-1);
+                }
+                cfg->scroll_rate_limit = rate;
+                break;
+            }
+            case 'k':
+            case 'K':
+            {
+                char* end;
+                double value = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || value < 0)
+                {
+                    logg(LOG_FATAL, "error parsing value for -%c. It must be a positive number.", c);
+                    exit(-1);
+                }
+                if (c == 'k')
+                    cfg->kinetic_time_constant_ms = value;
+                else
+                    cfg->kinetic_friction = value;
+                break;
+            }
+            case 'b':
+            {
+                intmax_t num = strtoimax(optarg, NULL, 10);
+                if (errno == ERANGE || num < 1)
+                {
+                    logg(LOG_FATAL, "error parsing value for -%c. It must be a positive integer.", c);
+                    exit(-1);
+                }
+                cfg->scroll_burst = (uint) num;
+                break;
+            }
             case 's':
             {
                 cvalue = optarg;
@@ -157,6 +515,22 @@ void parse_args_into_config(int argc, char** argv, struct Config* cfg) {
                 }
                 break;
             }
+            case 'p':
+                if (cfg->num_pointer_device_names == MAX_POINTER_DEVICES)
+                {
+                    logg(LOG_FATAL, "too many pointer devices, at most %d can be given with -%c.\n", MAX_POINTER_DEVICES, c);
+                    exit(-1);
+                }
+                cfg->pointer_device_names[cfg->num_pointer_device_names++] = optarg;
+                break;
+            case 'e':
+                if (cfg->num_evdev_device_paths == MAX_EVDEV_DEVICES)
+                {
+                    logg(LOG_FATAL, "too many evdev devices, at most %d can be given with -%c.\n", MAX_EVDEV_DEVICES, c);
+                    exit(-1);
+                }
+                cfg->evdev_device_paths[cfg->num_evdev_device_paths++] = optarg;
+                break;
             case 't':
                 cfg->is_toggle_mode_on = True;
                 break;
@@ -164,15 +538,37 @@ void parse_args_into_config(int argc, char** argv, struct Config* cfg) {
                 printf("Converts X pointer movement (mouse, touchpad, trackpoint, trackball) to scroll wheel events.\n\n");
                 printf("Options:\n");
                 printf("-s [xorg keycode:int] ([modifiers:int])\tshortcut\n");
-                printf("-c [d:int]\tconversion distance (speed): pointer travel distance (in pixels) required to trigger a scroll. Determines how frequently scrolling occurs. A lower number means more frequent scroll events.\n");
+                printf("-c [d:int]\tconversion distance (speed): pointer travel distance (in device counts) required to trigger a scroll. Determines how frequently scrolling occurs. A lower number means more frequent scroll events.\n");
+                printf("-m [mm:float]\tconversion distance in millimetres of travel, the same on any device that reports its resolution. Others keep -c\n");
+                printf("-l [clicks/s:float]\tscroll rate limit per axis. Faster movement is held back and scrolled later instead of being lost. Default: %g\n", DEFAULT_SCROLL_RATE_LIMIT);
+                printf("-b [clicks:int]\tscroll clicks that may be sent at once after a pause (see -l). Default: %u\n", DEFAULT_SCROLL_BURST);
+                printf("-k [ms:float]\tkinetic scrolling: keep scrolling after a flick, slowing down by 1/e every ms (e.g. 325). Default: off\n");
+                printf("-K [counts/s^2:float]\tkinetic scrolling: additional constant friction, stops the momentum sooner (with -k)\n");
+                printf("--accel [curve]\tscroll faster movement further: power:exponent[:v0], sigmoid:max gain:midpoint[:width] or piecewise:v=gain,v=gain,... with v in counts per ms (of -c). E.g. sigmoid:4:8. Default: linear\n");
+                printf("-p [device name]\tonly scroll with this pointer device (see `xinput list`), can be given multiple times. Default: all pointers\n");
+                printf("--profile [device name=c[,h][,r]]\tscroll with this pointer device with its own conversion distance (see -c, in mm with -m), h allows horizontal scrolling (see -H), r repeated scroll events (see -R). Can be given multiple times\n");
+                printf("-e [/dev/input/eventN]\tread the pointer and keyboard from this evdev device instead of XInput2, can be given multiple times. Pointers are grabbed while scrolling. With -o uinput no X server is needed. Default: XInput2\n");
                 printf("-r\t\treleases trigger button before first scroll. Example: if ctrl is the trigger key, a scroll would often resize/scale in a program. Releasing it prevents that.\n");
                 printf("-t\t\ttoggle mode: scrolling-mode stays enabled until the combo is pressed again\n");
                 printf("-R\t\tallow multiple scroll events to be generated from a fast wide pointer move\n");
+                printf("-o [xtest|uinput|fake]\toutput: xtest clicks the wheel buttons. uinput scrolls smoothly in fractions of a click with a virtual high resolution wheel (needs write access to /dev/uinput, -R is implied). fake only logs the scrolling. Default: xtest\n");
+                printf("-w\t\tkeep the pointer in place by warping it back after every move, instead of confining it with pointer barriers\n");
                 printf("-H\t\tallow horizontal scrolling\n");
                 printf("-d\t\tenable debug logging\n");
+                printf("-L [file]\twrite the log as compact binary records to file, for high-rate debug sessions (with -d). Decode it with MouseMoveToScrollLogDecode\n");
+                printf("-S\t\tprint statistics (wakeups, event rates, batching) about once per second. SIGUSR1 prints them any time.\n");
+                printf("--record [file]\trecord the raw motion while scrolling and the presses and releases of the trigger key (with the modifiers held) to a trace file, to replay them later. No other keys are recorded\n");
+                printf("--replay [file]\tfeed a recorded trace through the motion to scroll conversion as fast as possible and print the scrolls, with the current options. Needs no X server\n");
+                printf("--real-time\treplay the trace at the speed it was recorded (with --replay)\n");
+                printf("--flight-recorder [s:int]\tkeep the motion and scroll decisions of the last s seconds in memory, SIGUSR2 writes them to %s in $XDG_RUNTIME_DIR (else /tmp). 0: off. Default: %d\n",
+                       FLIGHT_RECORDER_DUMP_NAME, DEFAULT_FLIGHT_RECORDER_S);
+                printf("--latency-json [file|-]\tappend the latency histograms (input report to scroll decision, decision to flush: p50, p99, max) to file as a JSON line about once per second and on SIGUSR1. -: stdout\n");
                 printf("-v\t\tshow version\n");
                 printf("-h\t\tshow this help\n");
                 exit(0);
+            case 'w':
+                cfg->pointer_fixation = FIXATE_BY_WARPING;
+                break;
             case 'H':
                 cfg->allow_horizontal_scroll = True;
                 break;
@@ -186,6 +582,59 @@ void parse_args_into_config(int argc, char** argv, struct Config* cfg) {
                 cfg->show_debug_output = True;
                 log_level = LOG_DEBUG;
                 break;
+            case 'S':
+                cfg->show_stats = True;
+                break;
+            case 'L':
+                cfg->binary_log_path = optarg;
+                break;
+            case OPT_RECORD:
+                cfg->record_path = optarg;
+                break;
+            case OPT_REPLAY:
+                cfg->replay_path = optarg;
+                break;
+            case OPT_REAL_TIME:
+                cfg->replay_in_real_time = True;
+                break;
+            case OPT_FLIGHT_RECORDER:
+            {
+                intmax_t num = strtoimax(optarg, NULL, 10);
+                if (errno == ERANGE || num < 0 || num > 3600)
+                {
+                    logg(LOG_FATAL, "error parsing value for --flight-recorder. It must be 0 to 3600 seconds.");
+                    exit(-1);
+                }
+                cfg->flight_recorder_s = (int) num;
+                break;
+            }
+            case OPT_LATENCY_JSON:
+                cfg->latency_json_path = optarg;
+                break;
+            case OPT_PROFILE:
+                parse_device_profile(optarg, cfg);
+                break;
+            case OPT_ACCEL:
+                if (accel_curve_parse(&cfg->accel_curve, optarg) != 0)
+                {
+                    logg(LOG_FATAL, "error parsing --accel %s. It must be 'power:exponent[:v0]', 'sigmoid:max gain:midpoint[:width]' or 'piecewise:v=gain,v=gain,...'.\n", optarg);
+                    exit(-1);
+                }
+                cfg->accel_curve_spec = optarg;
+                break;
+            case 'o':
+                if (strcmp(optarg, "xtest") == 0)
+                    cfg->output_type = OUTPUT_XTEST;
+                else if (strcmp(optarg, "uinput") == 0)
+                    cfg->output_type = OUTPUT_UINPUT;
+                else if (strcmp(optarg, "fake") == 0)
+                    cfg->output_type = OUTPUT_FAKE;
+                else
+                {
+                    logg(LOG_FATAL, "error parsing value for -%c. It must be xtest, uinput or fake.\n", c);
+                    exit(-1);
+                }
+                break;
             case 'v':
                 printf("%s\n", PROGRAM_VERSION);
                 exit(0);
@@ -203,351 +652,2058 @@ void parse_args_into_config(int argc, char** argv, struct Config* cfg) {
     }
 }
 
-// tell Xlib that we want to receive pointer motion events
-static void request_to_receive_events(Display *dpy, Window win)
+// resolves the configured pointer device names to XI2 device ids. Without configured names the master pointers are used,
+// they deliver one raw event per physical report (with the slave as source).
+// from the device table, without asking the server
+static void resolve_pointer_devices(struct Config* cfg)
 {
-    XIEventMask evmasks[1];
-    unsigned char mask1[(XI_LASTEVENT + 7)/8];
+    device_selection.num_pointer_device_ids = 0;
+    device_selection.use_master_pointers = cfg->num_pointer_device_names == 0;
+    if (device_selection.use_master_pointers) return;
+
+    for (int i = 0; i < input_devices.num_devices && device_selection.num_pointer_device_ids < MAX_POINTER_DEVICES; i++)
+    {
+        struct InputDevice* dev = &input_devices.devices[i];
+        dev->is_selected = False;
+        if (!is_pointer_device(dev) || !dev->is_enabled)
+            continue;
+        for (int n = 0; n < cfg->num_pointer_device_names; n++)
+        {
+            if (strcasecmp(dev->name, cfg->pointer_device_names[n]) == 0)
+            {
+                logg(LOG_DEBUG, "using pointer device %d '%s'\n", dev->id, dev->name);
+                device_selection.pointer_device_ids[device_selection.num_pointer_device_ids++] = dev->id;
+                dev->is_selected = True;
+                break;
+            }
+        }
+    }
 
-    memset(mask1, 0, sizeof(mask1));
+    if (device_selection.num_pointer_device_ids == 0)
+        logg(LOG_WARN, "none of the configured pointer devices is present (yet)\n");
+}
 
-    /* select for button and key events from all master devices */
-    XISetMask(mask1, XI_RawMotion);
-    XISetMask(mask1, XI_KeyPress);
-    XISetMask(mask1, XI_KeyRelease);
-    //    XISetMask(mask1, XI_ButtonPress);
-    //    XISetMask(mask1, XI_ButtonRelease);
+static Bool is_selected_pointer_device(int device_id)
+{
+    for (int i = 0; i < device_selection.num_selected_device_ids; i++)
+    {
+        if (device_selection.selected_device_ids[i] == device_id)
+            return True;
+    }
+    return False;
+}
 
-    evmasks[0].deviceid = XIAllDevices;
-    evmasks[0].mask_len = sizeof(mask1);
-    evmasks[0].mask = mask1;
+// tell Xlib that we want to receive key events and, only while scrolling mode is active, pointer motion events.
+// raw motion arrives for every report of every pointer device, so selecting it all the time would wake us up constantly
+static void request_to_receive_events(Display *dpy, Window win, Bool with_motion)
+{
+    XIEventMask evmasks[2 + 2 * MAX_POINTER_DEVICES];
+    int num_evmasks = 0;
+    unsigned char master_mask[XIMaskLen(XI_LASTEVENT)];
+    unsigned char all_mask[XIMaskLen(XI_LASTEVENT)];
+    unsigned char motion_mask[XIMaskLen(XI_LASTEVENT)];
+
+    memset(master_mask, 0, sizeof(master_mask));
+    memset(all_mask, 0, sizeof(all_mask));
+    memset(motion_mask, 0, sizeof(motion_mask));
+
+    /* select for key events from all master devices, the source id tells which keyboard it was */
+    XISetMask(master_mask, XI_KeyPress);
+    XISetMask(master_mask, XI_KeyRelease);
+    //    XISetMask(master_mask, XI_ButtonPress);
+    //    XISetMask(master_mask, XI_ButtonRelease);
+    if (with_motion && device_selection.use_master_pointers)
+        XISetMask(master_mask, XI_RawMotion);
+
+    /* hot-plugging must be selected for on XIAllDevices */
+    XISetMask(all_mask, XI_HierarchyChanged);
+    XISetMask(all_mask, XI_DeviceChanged);
+    XISetMask(motion_mask, XI_RawMotion);
+
+    evmasks[num_evmasks++] = (XIEventMask) { .deviceid = XIAllMasterDevices, .mask_len = sizeof(master_mask), .mask = master_mask };
+    evmasks[num_evmasks++] = (XIEventMask) { .deviceid = XIAllDevices, .mask_len = sizeof(all_mask), .mask = all_mask };
+
+    // clear previous per device selections (mask_len 0 removes the mask), the devices might be gone or unplugged
+    for (int i = 0; i < device_selection.num_selected_device_ids; i++)
+        evmasks[num_evmasks++] = (XIEventMask) { .deviceid = device_selection.selected_device_ids[i], .mask_len = 0, .mask = NULL };
+    device_selection.num_selected_device_ids = 0;
+
+    if (with_motion && !device_selection.use_master_pointers)
+    {
+        for (int i = 0; i < device_selection.num_pointer_device_ids; i++)
+        {
+            int device_id = device_selection.pointer_device_ids[i];
+            evmasks[num_evmasks++] = (XIEventMask) { .deviceid = device_id, .mask_len = sizeof(motion_mask), .mask = motion_mask };
+            device_selection.selected_device_ids[device_selection.num_selected_device_ids++] = device_id;
+        }
+    }
 
-    XISelectEvents(dpy, win, evmasks, 1);
+    XISelectEvents(dpy, win, evmasks, num_evmasks);
 
     XFlush(dpy);
 }
 
-/* Return 1 if XI2 is available, 0 otherwise */
-static int has_xi2(Display *dpy)
+static const struct DeviceProfile* find_device_profile(struct Config* cfg, const char* device_name)
 {
-    /* We support XI 2.2 */
-    int major = 2;
-    int minor = 2;
-
-    int rc = XIQueryVersion(dpy, &major, &minor);
-    if (rc == BadRequest)
+    for (int i = 0; i < cfg->num_device_profiles; i++)
     {
-        logg(LOG_FATAL, "XI2 not supported. XI Version required: 2.2, found: %d.%d only.\n", major, minor);
-        return 0;
+        if (strcasecmp(cfg->device_profiles[i].device_name, device_name) == 0)
+            return &cfg->device_profiles[i];
     }
-    else if (rc != Success)
+    return NULL;
+}
+
+// with -m the device's counts are converted to the units of -c, so its threshold's worth of millimetres is a click.
+// only with the resolution of both axes: with one axis in mm and the other in counts diagonal motion would be skewed.
+// the factors are cached, the motion costs one multiply per axis
+static void set_device_motion_scale(struct InputDevice* device, struct Config* cfg)
+{
+    device->motion_scale[0] = device->motion_scale[1] = 1;
+    if (cfg->scroll_threshold_mm == 0) return;
+    if (device->counts_per_mm[0] == 0 || device->counts_per_mm[1] == 0)
     {
-        logg(LOG_WARN, "Internal Error! XIQueryVersion reportet non success..\n");
+        logg(LOG_DEBUG, "pointer device %d '%s' doesn't report its resolution, -c applies\n", device->id, device->name);
+        return;
     }
 
-    return 1;
+    const struct DeviceProfile* profile = find_device_profile(cfg, device->name);
+    double threshold_mm = profile != NULL ? profile->threshold : cfg->scroll_threshold_mm;
+    for (int axis = 0; axis < 2; axis++)
+        device->motion_scale[axis] = cfg->mouse_move_delta_to_scroll_threshold / (threshold_mm * device->counts_per_mm[axis]);
 }
 
-// scroll wheel input in linux is modelled as (mouse) buttons presses
-// Button 4: (scrolls up), Button 5 (scrolls down)
-// Button 6 (scrolls left), Button 7 (scrolls right)
-void trigger_scroll(Display* display, struct Config* cfg, enum ScrollDirection scrollDirection, int amount)
+// the device's motion is scrolled by its own core, with its profile's options if it has one.
+// raw motion of a master has the slave as source, so only the slaves need one
+static void set_up_device_scroll_core(struct InputDevice* device, struct Config* cfg)
 {
-    if (amount == 0) return;
-
-    logg(LOG_INFO, "scroll %s, %dx %s\n",
-         scrollDirection == SCROLL_VERTICAL ? "v" : "h",
-         cfg->allow_triggering_of_repeated_scroll_event ? abs(amount) : 1,
-         amount < 0 ? "up" : "down");
+    if (!is_pointer_device(device) || device->use == XIMasterPointer) return;
 
-    uint negative_scroll_amount_btn = scrollDirection == SCROLL_VERTICAL ? SCROLL_UP : SCROLL_LEFT;
-    uint postitive_scroll_amount_btn = scrollDirection == SCROLL_VERTICAL ? SCROLL_DOWN : SCROLL_RIGHT;
-    uint scroll_button = amount <  0 ? negative_scroll_amount_btn : postitive_scroll_amount_btn;
-
-    for (int i = 0; i < abs(amount); i++)
+    set_device_motion_scale(device, cfg);
+    struct ScrollCoreConfig core_cfg = scroll_core_cfg;
+    const struct DeviceProfile* profile = find_device_profile(cfg, device->name);
+    if (profile != NULL)
     {
-        // XSendEvent doesn't seem to work, so XTestFakeButtonEvent is used
-        XTestFakeButtonEvent(display, scroll_button, 1, CurrentTime); // "button" down
-        XTestFakeButtonEvent(display, scroll_button, 0, CurrentTime); // "button" up
-        if (!cfg->allow_triggering_of_repeated_scroll_event)
-            break;
+        logg(LOG_DEBUG, "pointer device %d '%s' has a profile\n", device->id, device->name);
+        if (cfg->scroll_threshold_mm == 0) // in mm the threshold is part of the scale
+            core_cfg.threshold = profile->threshold;
+        core_cfg.allow_horizontal_scroll = profile->allow_horizontal_scroll;
+        core_cfg.allow_repeated_scroll = profile->allow_triggering_of_repeated_scroll_event;
     }
+    scroll_core_init(&device->core, &core_cfg, scroll_sink, scroll_clock);
+    device->core.recorder = scroll_core.recorder;
+    scroll_core_set_active(&device->core, scroll_core.is_active);
 }
 
-struct ScreenPoint get_pointer_position(Display* display, Window window)
+static void set_up_device_scroll_cores(struct Config* cfg)
 {
-    struct ScreenPoint pos;
-
-    Window  root_ret, child_ret;
-    int win_x, win_y;
-    unsigned int mask;
-    XQueryPointer(display, window,
-                  &root_ret, &child_ret,
-                  &pos.x, &pos.y,
-                  &win_x, &win_y,
-                  &mask);
-
-    return pos;
+    for (int i = 0; i < input_devices.num_devices; i++)
+        set_up_device_scroll_core(&input_devices.devices[i], cfg);
 }
 
-// returns xi opcode
-int ensure_xinput2_or_exit(Display* display)
+// the core of a raw motion source device, the shared one for sources that aren't XI2 pointers (evdev, replays)
+static struct ScrollCore* get_source_scroll_core(int source_id)
 {
-    int xi_opcode, event, error;
-    if (!XQueryExtension(display, "XInputExtension", &xi_opcode, &event, &error)) {
-        logg(LOG_FATAL, "Error: X Input extension not available.");
-        exit(-3);
-    }
-
-    if (!has_xi2(display))
-        exit(-4);
-
-    return xi_opcode;
+    struct InputDevice* device = find_input_device(&input_devices, source_id);
+    if (device == NULL || !is_pointer_device(device) || device->use == XIMasterPointer)
+        return &scroll_core;
+    return &device->core;
 }
 
-Display* open_display_or_exit()
+// the shared scroll core and every pointer device's, into cores. Returns how many
+static int get_scroll_cores(struct ScrollCore** cores)
 {
-    char* display_name = NULL;
-    Display* display;
-    if ((display = XOpenDisplay(display_name)) == NULL) {
-        logg(LOG_FATAL, "Failed to open display.\n");
-        exit(-1);
+    int num_cores = 0;
+    cores[num_cores++] = &scroll_core;
+    for (int i = 0; i < input_devices.num_devices; i++)
+    {
+        struct InputDevice* device = &input_devices.devices[i];
+        if (is_pointer_device(device) && device->use != XIMasterPointer)
+            cores[num_cores++] = &device->core;
     }
-    return display;
+    return num_cores;
 }
 
-void before_synthethic_scroll(Display* display, struct Config* cfg)
+static struct ScrollCoreStats get_scroll_stats()
 {
-    if (cfg->release_trigger_button && scrolls_since_active == 0)
+    struct ScrollCore* cores[MAX_INPUT_DEVICES + 1];
+    int num_cores = get_scroll_cores(cores);
+    struct ScrollCoreStats total = input_devices.retired_stats;
+    for (int i = 0; i < num_cores; i++)
     {
-        XTestFakeKeyEvent(display, (uint)cfg->trigger_key_code, False, 0);
+        total.scrolls += cores[i]->stats.scrolls;
+        total.rate_limited_decisions += cores[i]->stats.rate_limited_decisions;
+        total.discarded_backlog_clicks += cores[i]->stats.discarded_backlog_clicks;
     }
-    scrolls_since_active++;
+    return total;
 }
 
-void set_is_active(Bool active, Display* display, Window window)
+// one device's part of a hierarchy change: added, removed, enabled, disabled, attached or detached.
+// only a new device is queried, the others are updated from the event
+static void handle_device_hierarchy_change(struct EventLoop* loop, int device_id, int flags, int attachment, Bool is_enabled)
 {
-    if (active == is_active) return;
+    if (!(flags & (XIMasterAdded | XIMasterRemoved | XISlaveAdded | XISlaveRemoved | XIDeviceEnabled | XIDeviceDisabled
+                   | XISlaveAttached | XISlaveDetached)))
+        return;
+
+    logg(LOG_DEBUG, "device %d hierarchy changed (flags %d)\n", device_id, flags);
+    struct InputDevice* added = update_input_device(&input_devices, loop->display, device_id, flags, attachment, is_enabled);
+    if (added != NULL)
+        set_up_device_scroll_core(added, loop->cfg);
+}
 
-    logg(LOG_INFO, active ? "activating\n" : "deactivating\n");
+// after the devices of a hierarchy change were updated: pick up the configured devices again
+static void handle_hierarchy_changed(struct EventLoop* loop)
+{
+    if (device_selection.use_master_pointers) return; // master pointers stay, nothing to select
 
-    is_active = active;
-    scrolls_since_active = 0; // reset
+    resolve_pointer_devices(loop->cfg);
+    request_to_receive_events(loop->display, loop->window, scroll_core.is_active);
+}
 
-    // hide/show cursor
-    if (is_active)
-        XFixesHideCursor(display, window);
-    else
-        XFixesShowCursor(display, window);
+// the device's axes changed, e.g. another slave is now behind a master, or a tablet switched modes
+static void handle_device_changed(struct EventLoop* loop, int device_id, int reason)
+{
+    if (reason != XIDeviceChange) return; // the slave switch of a master, nothing changed for the slaves
+    struct InputDevice* device = find_input_device(&input_devices, device_id);
+    if (device == NULL || !is_pointer_device(device) || device->use == XIMasterPointer) return;
+
+    logg(LOG_DEBUG, "device %d '%s' changed\n", device->id, device->name);
+    reload_input_device_axes(&input_devices, loop->display, device_id);
+    device->is_recorded = False; // its resolution may have changed
+    set_device_motion_scale(device, loop->cfg);
+    scroll_core_discard_backlog(&device->core); // movement in the old units
 }
 
-struct timespec diff_timespec(struct timespec start, struct timespec end)
+// with XIAllDevices or a master and one of its slaves selected the same physical report arrives twice:
+// once from the slave and once from the master, both with the slave as source and the same time.
+// returns True if the event is such a copy of the previously seen report of its source device.
+static Bool is_duplicate_raw_motion(int device_id, int source_id, Time time)
 {
-    struct timespec temp;
-    if ((end.tv_nsec-start.tv_nsec) < 0)
+    // device ids are small numbers, a direct mapped table is enough. A colliding source just overwrites the slot.
+    struct RawMotionSource* src = &device_selection.sources[source_id % MAX_RAW_MOTION_SOURCES];
+    if (src->source_id != source_id)
     {
-        temp.tv_sec = end.tv_sec-start.tv_sec - 1;
-        temp.tv_nsec = 1000000000 + end.tv_nsec - start.tv_nsec;
+        src->source_id = source_id;
+        src->device_id = -1;
     }
-    else
+
+    Bool is_duplicate = src->device_id != -1
+            && src->device_id != device_id
+            && src->time == time;
+    if (!is_duplicate)
     {
-        temp.tv_sec = end.tv_sec - start.tv_sec;
-        temp.tv_nsec = end.tv_nsec - start.tv_nsec;
+        src->device_id = device_id;
+        src->time = time;
     }
-    return temp;
+    return is_duplicate;
 }
 
-void check_for_scroll_trigger(enum ScrollDirection scroll_direction, double* total_movement_delta, double delta, struct Config* cfg, Display* display)
+/* Return 1 if XI2 is available, 0 otherwise */
+static int has_xi2(Display *dpy)
 {
-    logg(LOG_DEBUG, "check: dir: %s, total_movement_delta: %g, delta: %g, thres: %d\n",
-          scroll_direction == SCROLL_VERTICAL ? "v" : "h",
-          *total_movement_delta,
-          delta,
-          cfg->mouse_move_delta_to_scroll_threshold);
+    /* We support XI 2.2 */
+    int major = 2;
+    int minor = 2;
 
-    *total_movement_delta += delta;
-    if (fabs(*total_movement_delta) > cfg->mouse_move_delta_to_scroll_threshold)
+    int rc = XIQueryVersion(dpy, &major, &minor);
+    if (rc == BadRequest)
     {
-        struct timespec now;
-        clock_gettime(CLOCK_REALTIME, &now);
-
-        struct timespec time_since_last_scroll = diff_timespec(last_scroll_time, now);
-        if (time_since_last_scroll.tv_sec == 0 && (time_since_last_scroll.tv_nsec / NANOSECOND_TO_MILLISECOND_DIV) < SCROLL_TRIGGER_SPEED_LIMIT_MS)
-        {
-            logg(LOG_DEBUG, "rate limited, last scroll was just %dms ago.   \n", time_since_last_scroll.tv_nsec / NANOSECOND_TO_MILLISECOND_DIV);
-            *total_movement_delta = 0; // reset total so we don't rate limit a bunch of time for the next pointer move events, it needs to build up the total again
-            return;
-        }
-
-        before_synthethic_scroll(display, cfg);
-
-        int scroll_amount = (int) (*total_movement_delta / cfg->mouse_move_delta_to_scroll_threshold);
-        last_scroll_time = now;
-        trigger_scroll(display, cfg, scroll_direction, scroll_amount);
-
-        // adjust accumulator: reduce for distance traveled that is 'used up' by scrolling
-        // example: y mouse delta is 22, scroll threshold is 10, then scrollamount is 2 (2*10) and the (2*10) is subtracted from accumulator
-        // the (abs) new value of total_movement_y_delta is smaller mouse_move_delta_to_scroll_threshold
-        int scroll_amount_as_movement_amount = scroll_amount * (int) cfg->mouse_move_delta_to_scroll_threshold;
-        *total_movement_delta -= scroll_amount_as_movement_amount;
+        logg(LOG_FATAL, "XI2 not supported. XI Version required: 2.2, found: %d.%d only.\n", major, minor);
+        return 0;
     }
-}
-
-// -1 returned if device is not found
-int find_input_device_id_by_name(Display* display, const char* device_name)
-{
-    int ret = -1;
-    int numDevices = 0;
-    XDeviceInfo* dd = XListInputDevices(display, &numDevices);
-    for (int i = 0; i < numDevices; i++)
+    else if (rc != Success)
     {
-        // printf("%s %ld %ld\n", dd[i].name, dd[i].id);
-        fflush(stdout);
-        if (strcasecmp(dd[i].name, device_name) == 0)
-        {
-            ret = (int) dd[i].id;
-            break;
-        }
+        logg(LOG_WARN, "Internal Error! XIQueryVersion reportet non success..\n");
     }
-    XFreeDeviceList(dd);
-    return ret;
+
+    return 1;
 }
 
-Bool is_trigger_shortcut(int key_code, int modifiers, struct Config* cfg)
+// called by the event loop. Returns False if the queue is full and the command was dropped.
+// the command is sent after the next publish_emit_commands().
+Bool push_emit_command(struct EmitCommand cmd)
 {
-    //  printf("k %d, mod %d", key_code, modifiers);
-    if (cfg->trigger_key_modifiers > 0 // need to check modifiers?
-            && (modifiers & cfg->trigger_key_modifiers) != modifiers) // check modifiers
+    unsigned long depth = emit_queue_push(&emitter.queue, &cmd, cmd.type == EMIT_SCROLL ? EMIT_QUEUE_KEY_SLOTS : 0);
+    if (depth == 0)
     {
+        if (cmd.type == EMIT_SCROLL) // a key release is retried, see release_key()
+            emitter.dropped_commands++;
         return False;
     }
-    return key_code == cfg->trigger_key_code;
+    if (depth > emitter.max_queue_depth)
+        emitter.max_queue_depth = depth;
+    return True;
 }
 
-void ensure_single_instance_or_exit()
+// hand the commands queued while handling a drain to the emitter thread as one batch, and wake it up
+void publish_emit_commands()
 {
-    // /tmp is often mounted as ramdisk (tmpfs)
-    int pid_file = open("/tmp/MouseToScroll.pid", O_CREAT | O_RDWR, 0666);
-    int rc = flock(pid_file, LOCK_EX | LOCK_NB); // non-blocking
-    if (rc)
-    {
-        if(EWOULDBLOCK == errno)
-        {
-            fprintf(stderr, "another instance is already running\n");
-            exit(-9);
-        }
-    }
+    if (!emit_queue_publish(&emitter.queue)) return;
+    emitter.published_batches++;
+
+    uint64_t one = 1;
+    if (write(emitter.wakeup_fd, &one, sizeof(one)) != sizeof(one))
+        logg(LOG_ERROR, "failed to wake up emitter thread: %s\n", strerror(errno));
 }
 
-int main(int argc, char **argv)
+// Xlib calls this right before writing its output buffer to the connection
+static void count_emitter_write(Display* display, XExtCodes* codes, const char* data, long len)
+{
+    (void) display; (void) codes; (void) data;
+    atomic_fetch_add_explicit(&emitter.writes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&emitter.bytes_written, (unsigned long) len, memory_order_relaxed);
+}
+
+static void count_loop_write(Display* display, XExtCodes* codes, const char* data, long len)
+{
+    (void) display; (void) codes; (void) data;
+    x_traffic.bytes_written += (unsigned long) len;
+}
+
+// Xlib calls this after every request function. The request's reply has been read if the server is known to have
+// processed it: that was a round trip. Requests issued through XCB directly are not seen
+static int count_round_trip(Display* display)
+{
+    if (LastKnownRequestProcessed(display) == XNextRequest(display) - 1)
+        x_traffic.round_trips++;
+    return 0;
+}
+
+// counts the traffic of the event loop's connection from now on
+static void watch_x_traffic(Display* display)
+{
+    XExtCodes* codes = XAddExtension(display);
+    XESetBeforeFlush(display, codes->extension, count_loop_write);
+    XSetAfterFunction(display, count_round_trip);
+}
+
+static struct XTraffic get_x_traffic(Display* display)
+{
+    struct XTraffic traffic = x_traffic;
+    traffic.requests = XNextRequest(display) - 1;
+    return traffic;
+}
+
+static struct XTraffic subtract_x_traffic(struct XTraffic a, struct XTraffic b)
+{
+    return (struct XTraffic)
+    {
+        .requests = a.requests - b.requests,
+        .round_trips = a.round_trips - b.round_trips,
+        .bytes_written = a.bytes_written - b.bytes_written,
+    };
+}
+
+static void add_x_traffic(struct XTraffic* to, struct XTraffic traffic)
+{
+    to->requests += traffic.requests;
+    to->round_trips += traffic.round_trips;
+    to->bytes_written += traffic.bytes_written;
+}
+
+// attributes the traffic since before to the handling of an event
+static void count_x_event_traffic(Display* display, enum XTrafficCause cause, struct XTraffic before)
+{
+    struct XTraffic traffic = subtract_x_traffic(get_x_traffic(display), before);
+    add_x_traffic(&stats.x_traffic_by_cause[cause], traffic);
+    add_x_traffic(&stats.x_event_traffic_in_iteration, traffic);
+    stats.x_events_by_cause[cause]++;
+    if (cause == X_CAUSE_RAW_MOTION && traffic.round_trips > 0 && !stats.has_warned_of_motion_round_trip)
+    {
+        logg(LOG_WARN, "handling raw motion waited for an X reply, every motion report pays a round trip\n");
+        stats.has_warned_of_motion_round_trip = True;
+    }
+}
+
+// called at the start of every loop iteration, for the traffic of the previous one (including its flush)
+static void count_x_iteration_traffic(Display* display)
+{
+    struct XTraffic now = get_x_traffic(display);
+    struct XTraffic traffic = subtract_x_traffic(now, stats.x_traffic_at_iteration);
+    stats.x_traffic_at_iteration = now;
+
+    // what the event handlers didn't cause, the loop did
+    add_x_traffic(&stats.x_traffic_by_cause[X_CAUSE_LOOP], subtract_x_traffic(traffic, stats.x_event_traffic_in_iteration));
+    stats.x_event_traffic_in_iteration = (struct XTraffic) { 0, 0, 0 };
+
+    stats.x_iterations++;
+    if (traffic.requests > stats.x_max_requests_per_iteration)
+        stats.x_max_requests_per_iteration = traffic.requests;
+    if (traffic.round_trips > 0)
+        stats.x_round_trip_iterations++;
+}
+
+void send_emit_command(struct OutputBackend* output, struct EmitCommand* cmd)
+{
+    switch (cmd->type)
+    {
+    case EMIT_SCROLL:
+        output->scroll(output, cmd->direction, cmd->clicks);
+        break;
+    case EMIT_KEY_RELEASE:
+        output->release_key(output, cmd->key_code);
+        break;
+    }
+}
+
+void* run_emitter(void* arg)
+{
+    (void) arg;
+    struct EmitQueue* queue = &emitter.queue;
+    while (1)
+    {
+        uint64_t kicks;
+        if (read(emitter.wakeup_fd, &kicks, sizeof(kicks)) != sizeof(kicks))
+        {
+            if (errno == EINTR) continue;
+            logg(LOG_ERROR, "emitter thread failed to wait for commands: %s\n", strerror(errno));
+            atomic_store_explicit(&emitter.has_stopped, 1, memory_order_release);
+            return NULL;
+        }
+
+        // the slots may be reused once head moves past them, keep what's needed after the flush
+        int64_t decided_ns[EMIT_QUEUE_CAPACITY];
+        int num_decided = 0;
+        for (unsigned long n = emit_queue_published(queue); n > 0; n--)
+        {
+            struct EmitCommand* cmd = emit_queue_front(queue);
+            if (cmd->decided_ns != 0)
+                decided_ns[num_decided++] = cmd->decided_ns;
+            send_emit_command(emitter.output, cmd);
+            emit_queue_pop(queue);
+            atomic_fetch_add_explicit(&emitter.sent_commands, 1, memory_order_relaxed);
+        }
+        emitter.output->flush(emitter.output);
+        int64_t flushed_ns = monotonic_ns();
+        for (int i = 0; i < num_decided; i++)
+            latency_record(&emitter.decision_to_flush_latency, (flushed_ns - decided_ns[i]) / 1000);
+#ifdef USE_XCB
+        // XCB writes bypass the Xlib flush hook, count the flushes instead
+        atomic_fetch_add_explicit(&emitter.writes, 1, memory_order_relaxed);
+#endif
+    }
+}
+
+void start_emitter_or_exit(Display* display, struct Config* cfg)
+{
+    emitter.display = display;
+    emitter.output = create_output_backend(cfg->output_type, display);
+    if (emitter.output == NULL)
+    {
+        logg(LOG_FATAL, "failed to set up the %s output\n", output_backend_type_name(cfg->output_type));
+        exit(-5);
+    }
+    if (display != NULL)
+    {
+        XExtCodes* codes = XAddExtension(display);
+        XESetBeforeFlush(display, codes->extension, count_emitter_write);
+    }
+
+    emitter.wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    if (emitter.wakeup_fd == -1)
+    {
+        logg(LOG_FATAL, "failed to create eventfd: %s\n", strerror(errno));
+        exit(-5);
+    }
+    int rc = pthread_create(&emitter.thread, NULL, run_emitter, NULL);
+    if (rc != 0)
+    {
+        logg(LOG_FATAL, "failed to start emitter thread: %s\n", strerror(rc));
+        exit(-5);
+    }
+}
+
+// clicks < 0: up/left
+static void trigger_scroll(void* data, enum ScrollDirection scrollDirection, double clicks)
+{
+    (void) data;
+    if (clicks == 0) return;
+
+    logg(LOG_INFO, "scroll %s, %gx %s\n",
+         scrollDirection == SCROLL_VERTICAL ? "v" : "h",
+         fabs(clicks),
+         clicks < 0 ? "up" : "down");
+
+    enum StatsPageScroll page_scroll = scrollDirection == SCROLL_VERTICAL ? (clicks < 0 ? STATS_SCROLL_UP : STATS_SCROLL_DOWN)
+                                                                        : (clicks < 0 ? STATS_SCROLL_LEFT : STATS_SCROLL_RIGHT);
+    stats_page_add(&stats_page->scrolls[page_scroll], 1);
+    PROBE2(scroll, (int) scrollDirection, (long) lround(clicks * 120));
+
+    int64_t now_ns = monotonic_ns();
+    if (stats.scroll_cause_us != 0)
+        latency_record(&stats.event_to_decision_latency, now_ns / 1000 - stats.scroll_cause_us);
+    if (stats.activation_event_us != 0)
+    {
+        latency_record(&stats.activation_to_first_scroll_latency, now_ns / 1000 - stats.activation_event_us);
+        stats.activation_event_us = 0;
+    }
+
+    struct EmitCommand cmd =
+    {
+        .type = EMIT_SCROLL,
+        .direction = scrollDirection,
+        .clicks = clicks,
+        .decided_ns = now_ns,
+    };
+    if (!push_emit_command(cmd))
+    {
+        logg(LOG_WARN, "emitter queue full, scroll dropped\n");
+        stats_page_add(&stats_page->dropped_scrolls, 1);
+    }
+}
+
+// asks the server, a round trip
+struct ScreenPoint get_pointer_position(Display* display, Window window)
+{
+    struct ScreenPoint pos;
+
+#ifdef USE_XCB
+    xcb_connection_t* connection = XGetXCBConnection(display);
+    xcb_query_pointer_reply_t* reply = xcb_query_pointer_reply(connection, xcb_query_pointer(connection, window), NULL);
+    pos.x = reply != NULL ? reply->root_x : 0;
+    pos.y = reply != NULL ? reply->root_y : 0;
+    free(reply);
+#else
+    Window  root_ret, child_ret;
+    int win_x, win_y;
+    unsigned int mask;
+    XQueryPointer(display, window,
+                  &root_ret, &child_ret,
+                  &pos.x, &pos.y,
+                  &win_x, &win_y,
+                  &mask);
+#endif
+
+    return pos;
+}
+
+// returns xi opcode
+int ensure_xinput2_or_exit(Display* display)
+{
+    int xi_opcode, event, error;
+    if (!XQueryExtension(display, "XInputExtension", &xi_opcode, &event, &error)) {
+        logg(LOG_FATAL, "Error: X Input extension not available.");
+        exit(-3);
+    }
+
+    if (!has_xi2(display))
+        exit(-4);
+
+    return xi_opcode;
+}
+
+Display* open_display_or_exit()
+{
+    char* display_name = NULL;
+    Display* display;
+    if ((display = XOpenDisplay(display_name)) == NULL) {
+        logg(LOG_FATAL, "Failed to open display.\n");
+        exit(-1);
+    }
+    return display;
+}
+
+// must not be dropped: a trigger key left held turns the scrolls into zooming or resizing
+static void release_key(void* data, unsigned int key_code)
+{
+    (void) data;
+    struct EmitCommand cmd = { .type = EMIT_KEY_RELEASE, .key_code = key_code };
+    while (!push_emit_command(cmd))
+    {
+        if (atomic_load_explicit(&emitter.has_stopped, memory_order_acquire))
+        {
+            // nobody makes room anymore, and nobody else uses the output: send it from here
+            logg(LOG_ERROR, "the emitter thread is gone, releasing key %u directly\n", key_code);
+            send_emit_command(emitter.output, &cmd);
+            emitter.output->flush(emitter.output);
+            return;
+        }
+        // even the reserved slot is taken, let the emitter thread make room
+        publish_emit_commands();
+        sched_yield();
+    }
+}
+
+// pointer barriers need XFixes 5.0, fall back to warping without them
+void ensure_pointer_fixation_supported(Display* display, struct Config* cfg)
+{
+    int major, minor;
+    if (cfg->pointer_fixation != FIXATE_BY_BARRIERS)
+        return;
+    if (XFixesQueryVersion(display, &major, &minor) && major >= 5)
+        return;
+
+    logg(LOG_WARN, "XFixes 5.0 (pointer barriers) not available, falling back to warping the pointer.\n");
+    cfg->pointer_fixation = FIXATE_BY_WARPING;
+}
+
+void release_pointer(Display* display)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (pointer_barriers[i] != 0)
+            XFixesDestroyPointerBarrier(display, pointer_barriers[i]);
+        pointer_barriers[i] = 0;
+    }
+}
+
+// confine the pointer to the pixel it is on with four barriers around it.
+// the server clamps the cursor, so no request per move is needed and no synthetic motion reaches other clients.
+// raw motion is not affected by barriers and still tells how far the device moved.
+void confine_pointer(Display* display, Window window, struct ScreenPoint pos)
+{
+    release_pointer(display);
+
+    // a pointer moving right stops in front of a vertical barrier, one moving left stops on it
+    pointer_barriers[0] = XFixesCreatePointerBarrier(display, window, pos.x, pos.y - 1, pos.x, pos.y + 2, 0, 0, NULL);
+    pointer_barriers[1] = XFixesCreatePointerBarrier(display, window, pos.x + 1, pos.y - 1, pos.x + 1, pos.y + 2, 0, 0, NULL);
+    pointer_barriers[2] = XFixesCreatePointerBarrier(display, window, pos.x - 1, pos.y, pos.x + 2, pos.y, 0, 0, NULL);
+    pointer_barriers[3] = XFixesCreatePointerBarrier(display, window, pos.x - 1, pos.y + 1, pos.x + 2, pos.y + 1, 0, 0, NULL);
+}
+
+void set_is_active(Bool active, Display* display, Window window)
+{
+    if (active == scroll_core.is_active) return;
+    if (active && is_screen_saver_on) return; // screen is locked or blanked, nothing to scroll
+
+    logg(LOG_INFO, active ? "activating\n" : "deactivating\n");
+
+    struct ScrollCore* cores[MAX_INPUT_DEVICES + 1];
+    int num_cores = get_scroll_cores(cores);
+    for (int i = 0; i < num_cores; i++)
+        scroll_core_set_active(cores[i], active);
+    is_trigger_key_released = False;
+    PROBE1(activation, (int) active);
+    if (active)
+        stats_page_add(&stats_page->activations, 1);
+
+    if (!scroll_core.is_active)
+        evdev_set_all_grabbed(evdev_inputs, num_evdev_inputs, False);
+    if (display == NULL) return;
+
+    if (num_evdev_inputs == 0)
+        request_to_receive_events(display, window, scroll_core.is_active);
+
+    // hide/show cursor
+    if (scroll_core.is_active)
+    {
+        XFixesHideCursor(display, window);
+    }
+    else
+    {
+        XFixesShowCursor(display, window);
+        release_pointer(display);
+    }
+}
+
+struct timespec diff_timespec(struct timespec start, struct timespec end)
+{
+    struct timespec temp;
+    if ((end.tv_nsec-start.tv_nsec) < 0)
+    {
+        temp.tv_sec = end.tv_sec-start.tv_sec - 1;
+        temp.tv_nsec = 1000000000 + end.tv_nsec - start.tv_nsec;
+    }
+    else
+    {
+        temp.tv_sec = end.tv_sec - start.tv_sec;
+        temp.tv_nsec = end.tv_nsec - start.tv_nsec;
+    }
+    return temp;
+}
+
+double timespec_to_ms(struct timespec t)
+{
+    return t.tv_sec * 1000.0 + (double) t.tv_nsec / NANOSECOND_TO_MILLISECOND_DIV;
+}
+
+int64_t monotonic_ms()
+{
+    return monotonic_ns() / NANOSECOND_TO_MILLISECOND_DIV;
+}
+
+// called for events that start timing sensitive work (activation), keeps estimate_event_time_now() in step with the server
+void sync_event_clock(struct EventLoop* loop, Time event_time)
+{
+    loop->event_time_minus_monotonic_ms = (int64_t) event_time - monotonic_ms();
+}
+
+EventTime estimate_event_time_now(struct EventLoop* loop)
+{
+    return (EventTime) (monotonic_ms() + loop->event_time_minus_monotonic_ms);
+}
+
+static EventTime scroll_clock_now(void* data)
+{
+    return estimate_event_time_now((struct EventLoop*) data);
+}
+
+static void release_trigger_key_once(void* data, unsigned int key_code)
+{
+    if (is_trigger_key_released) return;
+    is_trigger_key_released = True;
+    release_trigger_key(data, key_code);
+}
+
+static void init_scroll_core(struct EventLoop* loop, Bool has_high_resolution, struct ScrollSink sink, struct ScrollClock clock)
+{
+    struct Config* cfg = loop->cfg;
+    struct ScrollCoreConfig core_cfg =
+    {
+        .threshold = cfg->mouse_move_delta_to_scroll_threshold,
+        .rate_limit = cfg->scroll_rate_limit,
+        .burst = cfg->scroll_burst,
+        .backlog_limit_ms = SCROLL_BACKLOG_LIMIT_MS,
+        .allow_horizontal_scroll = cfg->allow_horizontal_scroll,
+        .allow_repeated_scroll = cfg->allow_triggering_of_repeated_scroll_event,
+        .has_high_resolution = has_high_resolution,
+        .release_key_code = cfg->release_trigger_button ? cfg->trigger_key_code : -1,
+        .accel = cfg->accel_curve_spec != NULL ? &cfg->accel_curve : NULL,
+    };
+    // every core releases the key before its first scroll, the key is released only for the first of them
+    release_trigger_key = sink.release_key;
+    sink.release_key = release_trigger_key_once;
+    scroll_core_init(&scroll_core, &core_cfg, sink, clock);
+    scroll_core_cfg = core_cfg;
+    scroll_sink = sink;
+    scroll_clock = clock;
+}
+
+// get notified when the screen saver kicks in (screen blanked or locked), so scrolling mode can be paused.
+// returns the screen saver event base, -1 if the extension is not available
+int request_to_receive_screen_saver_events(Display* display, Window window)
+{
+    int event_base, error_base;
+    if (!XScreenSaverQueryExtension(display, &event_base, &error_base))
+    {
+        logg(LOG_WARN, "MIT-SCREEN-SAVER extension not available, scrolling mode won't pause while the screen is locked.\n");
+        return -1;
+    }
+    XScreenSaverSelectInput(display, window, ScreenSaverNotifyMask);
+    return event_base;
+}
+
+void handle_screen_saver_event(int state, Display* display, Window window)
+{
+    is_screen_saver_on = state == ScreenSaverOn || state == ScreenSaverCycle;
+    logg(LOG_DEBUG, "screen saver %s\n", is_screen_saver_on ? "on" : "off");
+    if (is_screen_saver_on)
+        set_is_active(False, display, window);
+}
+
+static const char* X_CAUSE_NAMES[NUM_X_CAUSES] = { "raw motion", "key", "other event", "loop" };
+
+// X traffic per event of each kind (per iteration for the loop's own) and per loop iteration, since the start
+static void report_x_traffic()
+{
+    char by_cause[512];
+    int len = 0;
+    for (int i = 0; i < NUM_X_CAUSES && len < (int) sizeof(by_cause); i++)
+    {
+        struct XTraffic* traffic = &stats.x_traffic_by_cause[i];
+        unsigned long n = i == X_CAUSE_LOOP ? stats.x_iterations : stats.x_events_by_cause[i];
+        len += snprintf(by_cause + len, sizeof(by_cause) - (size_t) len, "%s%s %.2f/%.3f/%.1f",
+                        i > 0 ? ", " : "", X_CAUSE_NAMES[i],
+                        n ? (double) traffic->requests / n : 0.0,
+                        n ? (double) traffic->round_trips / n : 0.0,
+                        n ? (double) traffic->bytes_written / n : 0.0);
+    }
+
+    struct XTraffic total = { 0, 0, 0 };
+    for (int i = 0; i < NUM_X_CAUSES; i++)
+        add_x_traffic(&total, stats.x_traffic_by_cause[i]);
+    logg(LOG_INFO, "X traffic: requests/round trips/bytes written per event: %s; per loop iteration %.2f/%.3f/%.1f, "
+                   "max requests per iteration %lu, iterations with a round trip %lu of %lu\n",
+         by_cause,
+         stats.x_iterations ? (double) total.requests / stats.x_iterations : 0.0,
+         stats.x_iterations ? (double) total.round_trips / stats.x_iterations : 0.0,
+         stats.x_iterations ? (double) total.bytes_written / stats.x_iterations : 0.0,
+         stats.x_max_requests_per_iteration,
+         stats.x_round_trip_iterations,
+         stats.x_iterations);
+}
+
+void report_stats(Display* display)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct timespec since_report = diff_timespec(stats.last_report_time, now);
+    double since_report_ms = timespec_to_ms(since_report);
+    struct timespec cpu_time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+    struct ScrollCoreStats scroll_stats = get_scroll_stats();
+    int64_t cpu_ns = (int64_t) cpu_time.tv_sec * 1000000000 + cpu_time.tv_nsec;
+    unsigned long events_since_report = stats.drained_events - stats.drained_events_at_report;
+
+    unsigned long x_requests = display != NULL ? XNextRequest(display) - 1 : 0;
+    unsigned long queue_depth = atomic_load_explicit(&emitter.queue.tail, memory_order_relaxed)
+            - atomic_load_explicit(&emitter.queue.head, memory_order_relaxed);
+    logg(LOG_INFO, "stats: wakeups/s %.2f (total %lu), drain handling us avg %.1f max %.1f, CPU us per event %.2f, "
+                   "emitter queue depth %lu (max %lu) sent %lu dropped %lu writes per batch %.2f bytes per batch %.1f, X requests/s %.2f, warps %lu, raw motion events per report %.2f (%lu/%lu), "
+                   "events per drain %.2f, reports per motion batch %.2f (max %lu), input latency us avg %.1f max %lu, rate limited decisions %lu, discarded backlog clicks %lu, kinetic flicks %lu, dropped log messages %lu\n",
+         stats.wakeups_since_report * 1000.0 / since_report_ms,
+         stats.wakeups,
+         stats.drains ? stats.busy_ns_total / 1000.0 / stats.drains : 0.0,
+         stats.busy_ns_max / 1000.0,
+         events_since_report ? (cpu_ns - stats.cpu_ns_at_report) / 1000.0 / events_since_report : 0.0,
+         queue_depth,
+         emitter.max_queue_depth,
+         atomic_load_explicit(&emitter.sent_commands, memory_order_relaxed),
+         emitter.dropped_commands,
+         emitter.published_batches ? (double) atomic_load_explicit(&emitter.writes, memory_order_relaxed) / emitter.published_batches : 0.0,
+         emitter.published_batches ? (double) atomic_load_explicit(&emitter.bytes_written, memory_order_relaxed) / emitter.published_batches : 0.0,
+         (x_requests - stats.x_requests_at_report) * 1000.0 / since_report_ms,
+         stats.warps,
+         stats.raw_motion_reports ? (double) stats.raw_motion_events / stats.raw_motion_reports : 0.0,
+         stats.raw_motion_events,
+         stats.raw_motion_reports,
+         stats.drains ? (double) stats.drained_events / stats.drains : 0.0,
+         stats.motion_batches ? (double) stats.raw_motion_reports / stats.motion_batches : 0.0,
+         stats.max_motion_batch_size,
+         stats.input_latency_samples ? (double) stats.input_latency_us_total / stats.input_latency_samples : 0.0,
+         stats.input_latency_us_max,
+         scroll_stats.rate_limited_decisions,
+         scroll_stats.discarded_backlog_clicks,
+         stats.kinetic_flicks,
+         log_dropped_messages());
+    if (display != NULL)
+        report_x_traffic();
+
+    stats.wakeups_since_report = 0;
+    stats.x_requests_at_report = x_requests;
+    stats.cpu_ns_at_report = cpu_ns;
+    stats.drained_events_at_report = stats.drained_events;
+    stats.last_report_time = now;
+}
+
+// prints p50, p99 and max of the latency histograms, overall and since the previous report, and appends them to
+// the --latency-json file. The emitter thread keeps recording meanwhile.
+void report_latency(Bool print_text)
+{
+    struct LatencySnapshot event_to_decision, decision_to_flush;
+    latency_snapshot(&stats.event_to_decision_latency, &event_to_decision);
+    latency_snapshot(&emitter.decision_to_flush_latency, &decision_to_flush);
+    struct LatencySnapshot recent_event_to_decision = event_to_decision;
+    struct LatencySnapshot recent_decision_to_flush = decision_to_flush;
+    latency_subtract(&recent_event_to_decision, &latency_report.event_to_decision);
+    latency_subtract(&recent_decision_to_flush, &latency_report.decision_to_flush);
+
+    if (print_text)
+        logg(LOG_INFO, "latency us: event to decision p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 " (recent p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 "), "
+                       "decision to flush p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 " (recent p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 ")\n",
+             latency_percentile(&event_to_decision, 0.50), latency_percentile(&event_to_decision, 0.99), event_to_decision.max_us,
+             latency_percentile(&recent_event_to_decision, 0.50), latency_percentile(&recent_event_to_decision, 0.99), recent_event_to_decision.max_us,
+             latency_percentile(&decision_to_flush, 0.50), latency_percentile(&decision_to_flush, 0.99), decision_to_flush.max_us,
+             latency_percentile(&recent_decision_to_flush, 0.50), latency_percentile(&recent_decision_to_flush, 0.99), recent_decision_to_flush.max_us);
+
+    struct LatencySnapshot activation, activation_to_first_scroll;
+    latency_snapshot(&stats.activation_latency, &activation);
+    latency_snapshot(&stats.activation_to_first_scroll_latency, &activation_to_first_scroll);
+    if (print_text && activation.total > 0)
+        logg(LOG_INFO, "activation latency us: key press to activated p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 ", "
+                       "key press to first scroll p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 " (%" PRIu64 " activations)\n",
+             latency_percentile(&activation, 0.50), latency_percentile(&activation, 0.99), activation.max_us,
+             latency_percentile(&activation_to_first_scroll, 0.50), latency_percentile(&activation_to_first_scroll, 0.99),
+             activation_to_first_scroll.max_us, activation.total);
+
+    if (latency_report.json != NULL)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        FILE* json = latency_report.json;
+        flockfile(json); // one line, even with the log writer thread on stdout
+        fprintf(json, "{\"time_ms\":%" PRId64 ",\"event_to_decision\":", (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000);
+        latency_write_json(json, &event_to_decision);
+        fprintf(json, ",\"event_to_decision_recent\":");
+        latency_write_json(json, &recent_event_to_decision);
+        fprintf(json, ",\"decision_to_flush\":");
+        latency_write_json(json, &decision_to_flush);
+        fprintf(json, ",\"decision_to_flush_recent\":");
+        latency_write_json(json, &recent_decision_to_flush);
+        fprintf(json, ",\"activation\":");
+        latency_write_json(json, &activation);
+        fprintf(json, ",\"activation_to_first_scroll\":");
+        latency_write_json(json, &activation_to_first_scroll);
+        fprintf(json, "}\n");
+        fflush(json);
+        funlockfile(json);
+    }
+
+    latency_report.event_to_decision = event_to_decision;
+    latency_report.decision_to_flush = decision_to_flush;
+}
+
+Bool is_trigger_shortcut(int key_code, int modifiers, struct Config* cfg)
+{
+    //  printf("k %d, mod %d", key_code, modifiers);
+    if (cfg->trigger_key_modifiers > 0 // need to check modifiers?
+            && (modifiers & cfg->trigger_key_modifiers) != modifiers) // check modifiers
+    {
+        return False;
+    }
+    return key_code == cfg->trigger_key_code;
+}
+
+// the trace has only the keys that can change the active state, not what else was typed (e.g. passwords)
+static Bool is_recorded_key(int key_code, struct Config* cfg)
+{
+    return key_code == cfg->trigger_key_code;
+}
+
+void ensure_single_instance_or_exit()
+{
+    // /tmp is often mounted as ramdisk (tmpfs)
+    int pid_file = open("/tmp/MouseToScroll.pid", O_CREAT | O_RDWR, 0666);
+    int rc = flock(pid_file, LOCK_EX | LOCK_NB); // non-blocking
+    if (rc)
+    {
+        if(EWOULDBLOCK == errno)
+        {
+            fprintf(stderr, "another instance is already running\n");
+            exit(-9);
+        }
+    }
+}
+
+static struct KineticsConfig get_kinetics_config(struct Config* cfg)
+{
+    struct KineticsConfig kinetics_cfg =
+    {
+        .time_constant_ms = cfg->kinetic_time_constant_ms,
+        .friction = cfg->kinetic_friction,
+        .min_start_speed = KINETIC_MIN_START_CLICKS_PER_S * cfg->mouse_move_delta_to_scroll_threshold / 1000,
+        .min_speed = KINETIC_MIN_CLICKS_PER_S * cfg->mouse_move_delta_to_scroll_threshold / 1000,
+        .allow_horizontal = cfg->allow_horizontal_scroll,
+    };
+    return kinetics_cfg;
+}
+
+static void stop_coasting(struct EventLoop* loop)
+{
+    loop->kinetics.is_coasting = False;
+    timer_cancel(&loop->timers, &loop->kinetic_timer);
+}
+
+// one step of momentum: scroll what the velocity covers since the last step, then apply friction
+static void on_kinetic_timer(void* data)
+{
+    struct EventLoop* loop = (struct EventLoop*) data;
+    if (!scroll_core.is_active || !loop->kinetics.is_coasting) return;
+
+    EventTime now = estimate_event_time_now(loop);
+    struct KineticsConfig kinetics_cfg = get_kinetics_config(loop->cfg);
+    double delta_x, delta_y;
+    Bool is_coasting = kinetics_step(&loop->kinetics, &kinetics_cfg, now, &delta_x, &delta_y);
+    if (delta_x != 0 || delta_y != 0)
+        scroll_core_add_motion(&scroll_core, delta_x, delta_y, now);
+    if (!is_coasting)
+    {
+        stop_coasting(loop);
+        return;
+    }
+    timer_start(&loop->timers, &loop->kinetic_timer, KINETIC_TICK_MS * 1000000LL, 0);
+}
+
+// fires a while after motion was seen. Not restarted for every motion, it checks when the last one was.
+static void on_motion_stop_timer(void* data)
+{
+    struct EventLoop* loop = (struct EventLoop*) data;
+    struct Kinetics* kinetics = &loop->kinetics;
+    if (!scroll_core.is_active || kinetics->num_samples == 0) return;
+
+    EventTime now = estimate_event_time_now(loop);
+    int32_t since_motion_ms = (int32_t) (now - kinetics_latest_motion_time(kinetics));
+    if (since_motion_ms < KINETIC_MOTION_STOP_MS)
+    {
+        timer_start(&loop->timers, &loop->motion_stop_timer, (KINETIC_MOTION_STOP_MS - since_motion_ms) * 1000000LL, 1000000LL);
+        return;
+    }
+
+    struct KineticsConfig kinetics_cfg = get_kinetics_config(loop->cfg);
+    if (!kinetics_release(kinetics, &kinetics_cfg, now))
+        return;
+    stats.kinetic_flicks++;
+    timer_start(&loop->timers, &loop->kinetic_timer, KINETIC_TICK_MS * 1000000LL, 0);
+}
+
+// new motion takes over from the momentum and is recorded for the next release
+static void track_motion_for_kinetics(struct EventLoop* loop, EventTime time, double delta_x, double delta_y)
+{
+    if (loop->cfg->kinetic_time_constant_ms <= 0) return;
+
+    if (loop->kinetics.is_coasting)
+        stop_coasting(loop);
+    kinetics_record_motion(&loop->kinetics, time, delta_x, delta_y);
+    if (!loop->motion_stop_timer.is_armed)
+        timer_start(&loop->timers, &loop->motion_stop_timer, KINETIC_MOTION_STOP_MS * 1000000LL, 1000000LL);
+}
+
+// age of an event stamped by the X server, -1 when the stamp can't be CLOCK_MONOTONIC ms (Xvnc, Xpra use another
+// clock). Taken by subtracting, the 32 bit server time wraps around after ~49 days
+static int64_t get_event_age_us(EventTime time, int64_t now_us)
+{
+    int64_t age_us = (int64_t) (int32_t) ((EventTime) (now_us / 1000) - time) * 1000;
+    return age_us >= 0 && age_us <= MAX_EVENT_AGE_US ? age_us : -1;
+}
+
+static void record_input_latency(int64_t latency_us)
+{
+    stats.input_latency_us_total += (unsigned long) latency_us;
+    if ((unsigned long) latency_us > stats.input_latency_us_max)
+        stats.input_latency_us_max = (unsigned long) latency_us;
+    stats.input_latency_samples++;
+}
+
+// runs one scroll decision and one pointer fixation for all motion collected in the batch, then empties it
+static void apply_motion_batch(struct EventLoop* loop)
+{
+    struct MotionBatch* batch = &loop->motion_batch;
+    if (batch->num_events == 0) return;
+
+    stats.motion_batches++;
+    if (batch->num_events > stats.max_motion_batch_size)
+        stats.max_motion_batch_size = batch->num_events;
+
+    double delta_x = 0;
+    double delta_y = 0;
+    for (int i = 0; i < batch->num_devices; i++)
+    {
+        struct MotionBatchDevice* dev = &batch->devices[i];
+        struct InputDevice* device = find_input_device(&input_devices, dev->source_id);
+        if (device != NULL && is_pointer_device(device))
+        {
+            dev->delta_x *= device->motion_scale[0];
+            dev->delta_y *= device->motion_scale[1];
+        }
+        delta_x += dev->delta_x;
+        delta_y += dev->delta_y;
+    }
+    int num_devices = batch->num_devices;
+    batch->num_devices = 0;
+    batch->num_events = 0;
+
+    if (!scroll_core.is_active) return;
+
+    /// fixate pointer (set pointer to start pos): not the best solution (is wiggles a bit), barriers don't need it
+    if (loop->cfg->pointer_fixation == FIXATE_BY_WARPING && loop->display != NULL)
+    {
+#ifdef USE_XCB
+        xcb_warp_pointer(loop->connection, XCB_NONE, loop->window, 0, 0, 0, 0,
+                         loop->start_pointer_pos.x, loop->start_pointer_pos.y);
+#else
+        XWarpPointer(loop->display, None, loop->window, 0, 0, 0, 0,
+                     loop->start_pointer_pos.x, loop->start_pointer_pos.y);
+#endif
+        stats.warps++;
+        stats_page_add(&stats_page->warps, 1);
+    }
+
+    track_motion_for_kinetics(loop, batch->time, delta_x, delta_y);
+
+    /// update each device's movement deltas and check if we need to scroll
+    stats.scroll_cause_us = batch->first_report_us;
+    for (int i = 0; i < num_devices; i++)
+    {
+        struct MotionBatchDevice* dev = &batch->devices[i];
+        scroll_core_add_motion(get_source_scroll_core(dev->source_id), dev->delta_x, dev->delta_y, batch->time);
+    }
+    stats.scroll_cause_us = 0;
+}
+
+// adds a motion report to the batch, summed per source device and axis
+static void add_to_motion_batch(struct EventLoop* loop, int source_id, double delta_x, double delta_y, EventTime time,
+                                int64_t report_us)
+{
+    struct MotionBatch* batch = &loop->motion_batch;
+    if (batch->num_events == 0)
+        batch->first_report_us = report_us;
+
+    struct MotionBatchDevice* dev = NULL;
+    for (int i = 0; i < batch->num_devices; i++)
+    {
+        if (batch->devices[i].source_id == source_id)
+        {
+            dev = &batch->devices[i];
+            break;
+        }
+    }
+    if (dev == NULL)
+    {
+        if (batch->num_devices == MAX_POINTER_DEVICES)
+        {
+            // more pointers moving at once than expected, decide on what the others moved so far and start over
+            apply_motion_batch(loop);
+            batch->first_report_us = report_us;
+        }
+        dev = &batch->devices[batch->num_devices++];
+        dev->source_id = source_id;
+        dev->delta_x = 0;
+        dev->delta_y = 0;
+    }
+    dev->delta_x += delta_x;
+    dev->delta_y += delta_y;
+    batch->num_events++;
+    batch->time = time;
+}
+
+static struct StatsPageDevice* count_received_motion(int source_id)
+{
+    struct StatsPageDevice* device = stats_page_device(stats_page, source_id);
+    stats_page_add(&device->events, 1);
+    stats_page_add(&stats_page->events, 1);
+    return device;
+}
+
+static void count_ignored_motion(struct StatsPageDevice* device)
+{
+    stats_page_add(&device->ignored_events, 1);
+    stats_page_add(&stats_page->ignored_events, 1);
+}
+
+// the device's resolution and name go into the trace before its first motion, for the scale and profile on replay.
+// the sources that aren't XI2 pointers have neither, their motion isn't scaled
+static void record_device_on_first_motion(int source_id, EventTime time)
+{
+    struct InputDevice* device = find_input_device(&input_devices, source_id);
+    if (device == NULL || !is_pointer_device(device) || device->is_recorded) return;
+
+    struct TraceEvent event = { .type = TRACE_DEVICE, .time = time, .device_id = source_id,
+                                .counts_per_mm = { device->counts_per_mm[0], device->counts_per_mm[1] } };
+    snprintf(event.device_name, sizeof(event.device_name), "%s", device->name);
+    trace_write(recording, &event);
+    device->is_recorded = True;
+}
+
+static void handle_raw_motion(struct EventLoop* loop, int device_id, int source_id, Time time, double delta_x, double delta_y)
+{
+    struct StatsPageDevice* page_device = count_received_motion(source_id);
+    PROBE2(raw_motion, source_id, (unsigned long) time);
+    if (!scroll_core.is_active)
+    {
+        count_ignored_motion(page_device);
+        return;
+    }
+
+    if (recording != NULL)
+    {
+        record_device_on_first_motion(source_id, (EventTime) time);
+        struct TraceEvent event = { .type = TRACE_MOTION, .time = (EventTime) time, .device_id = device_id,
+                                    .source_id = source_id, .delta_x = delta_x, .delta_y = delta_y };
+        trace_write(recording, &event);
+    }
+
+    stats.raw_motion_events++;
+    if ((!device_selection.use_master_pointers && !is_selected_pointer_device(device_id))
+            || is_duplicate_raw_motion(device_id, source_id, time))
+    {
+        count_ignored_motion(page_device);
+        return;
+    }
+    stats.raw_motion_reports++;
+    flight_record(flight_recorder, (EventTime) time, FLIGHT_RAW_MOTION, 0, source_id, delta_x, delta_y);
+
+    // Xorg stamps events with CLOCK_MONOTONIC ms, other servers' reports are stamped on receipt
+    int64_t now_us = monotonic_ns() / 1000;
+    int64_t age_us = get_event_age_us((EventTime) time, now_us);
+    if (age_us != -1)
+        record_input_latency(age_us);
+    add_to_motion_batch(loop, source_id, delta_x, delta_y, (EventTime) time, age_us != -1 ? now_us - age_us : now_us);
+}
+
+// a key was pressed on a real keyboard, from XInput2 or evdev
+static struct ScreenPoint get_tracked_pointer_position(struct EventLoop* loop)
+{
+    if (loop->is_pointer_pos_known)
+        return loop->pointer_pos;
+    logg(LOG_DEBUG, "pointer position not known from events, querying it\n");
+    return get_pointer_position(loop->display, loop->window);
+}
+
+static void track_pointer_position(struct EventLoop* loop, int root_x, int root_y)
+{
+    loop->pointer_pos.x = root_x;
+    loop->pointer_pos.y = root_y;
+    loop->is_pointer_pos_known = True;
+}
+
+static void handle_key_press(struct EventLoop* loop, int key_code, int modifiers, Bool is_repeat, EventTime time)
+{
+    struct Config* cfg = loop->cfg;
+    Display* display = loop->display;
+    Window window = loop->window;
+
+    logg(LOG_DEBUG, "KeyPress: key_code %d, mods %d, is_repeat %d\n", key_code, modifiers, is_repeat);
+    if (recording != NULL && is_recorded_key(key_code, cfg))
+    {
+        struct TraceEvent event = { .type = TRACE_KEY_PRESS, .time = time, .key_code = key_code,
+                                    .modifiers = modifiers, .is_repeat = is_repeat };
+        trace_write(recording, &event);
+    }
+    if (!is_trigger_shortcut(key_code, modifiers, cfg) || is_repeat)
+        return;
+
+    Bool was_active = scroll_core.is_active;
+    if (cfg->is_toggle_mode_on)
+    {
+        set_is_active(!scroll_core.is_active, display, window);
+    }
+    else if (!scroll_core.is_active)
+    {
+        set_is_active(True, display, window);
+    }
+
+    if (!scroll_core.is_active)
+    {
+        stats.activation_event_us = 0;
+        return;
+    }
+
+    sync_event_clock(loop, time);
+    switch (cfg->pointer_fixation)
+    {
+    case FIXATE_BY_BARRIERS:
+        loop->start_pointer_pos = get_tracked_pointer_position(loop);
+        confine_pointer(display, window, loop->start_pointer_pos);
+        break;
+    case FIXATE_BY_WARPING:
+        loop->start_pointer_pos = get_tracked_pointer_position(loop);
+        break;
+    case FIXATE_BY_GRABBING:
+        evdev_set_all_grabbed(evdev_inputs, num_evdev_inputs, True);
+        break;
+    }
+
+    if (!was_active)
+    {
+        // stamped on receipt when the server time isn't CLOCK_MONOTONIC ms
+        int64_t now_us = monotonic_ns() / 1000;
+        int64_t age_us = get_event_age_us(time, now_us);
+        stats.activation_event_us = age_us != -1 ? now_us - age_us : now_us;
+        if (age_us != -1)
+            latency_record(&stats.activation_latency, age_us);
+    }
+}
+
+static void handle_key_release(struct EventLoop* loop, int key_code, EventTime time)
 {
-    ensure_single_instance_or_exit();
+    if (recording != NULL && is_recorded_key(key_code, loop->cfg))
+    {
+        struct TraceEvent event = { .type = TRACE_KEY_RELEASE, .time = time, .key_code = key_code };
+        trace_write(recording, &event);
+    }
+    if (loop->cfg->is_toggle_mode_on) return;
 
-    struct Config cfg = create_default_config();
-    parse_args_into_config(argc, argv, &cfg);
+    logg(LOG_DEBUG, "KeyRelease: key_code %d\n", key_code);
+    if (scroll_core.is_active && is_trigger_shortcut(key_code, 0, loop->cfg))
+        set_is_active(False, loop->display, loop->window);
+}
 
-    if (cfg.show_debug_output)
-        print_cfg(&cfg);
+#ifndef USE_XCB
+// the raw values are packed for the valuators set in the mask, picks those of axis 0 and 1
+static void get_raw_motion_deltas(XIRawEvent* event, double* delta_x, double* delta_y)
+{
+    *delta_x = 0;
+    *delta_y = 0;
+    int value_index = 0;
+    for (int axis = 0; axis < 2 && axis < event->valuators.mask_len * 8; axis++)
+    {
+        if (!XIMaskIsSet(event->valuators.mask, axis)) continue;
+        if (axis == 0)
+            *delta_x = event->raw_values[value_index];
+        else
+            *delta_y = event->raw_values[value_index];
+        value_index++;
+    }
+}
 
-    if (cfg.trigger_key_code == UNSPECIFIED_KEY_CODE)
-        logg(LOG_WARN, "warning: no trigger key code was specified\n");
+static void handle_xi_event(XGenericEventCookie* cookie, struct EventLoop* loop)
+{
+    // keep the order of motion and key events: motion before a (de)activation belongs to the previous mode
+    if (cookie->evtype != XI_RawMotion)
+        apply_motion_batch(loop);
+
+    switch (cookie->evtype) {
+    case XI_KeyPress:
+    {
+        XIDeviceEvent* event = (XIDeviceEvent*) cookie->data;
+        track_pointer_position(loop, (int) event->root_x, (int) event->root_y);
+        if (event->sourceid != loop->xtest_keyboard_device_id)
+            handle_key_press(loop, event->detail, event->mods.base, event->flags & XIKeyRepeat, (EventTime) event->time);
+        break;
+    }
+    case XI_KeyRelease:
+    {
+        XIDeviceEvent* event = (XIDeviceEvent*) cookie->data;
+        track_pointer_position(loop, (int) event->root_x, (int) event->root_y);
+        if (event->sourceid != loop->xtest_keyboard_device_id)
+            handle_key_release(loop, event->detail, (EventTime) event->time);
+        break;
+    }
+    case XI_ButtonPress:
+        break;
+    case XI_HierarchyChanged:
+    {
+        XIHierarchyEvent* event = (XIHierarchyEvent*) cookie->data;
+        for (int i = 0; i < event->num_info; i++)
+        {
+            XIHierarchyInfo* info = &event->info[i];
+            handle_device_hierarchy_change(loop, info->deviceid, info->flags, info->attachment, info->enabled);
+        }
+        handle_hierarchy_changed(loop);
+        break;
+    }
+    case XI_DeviceChanged:
+    {
+        XIDeviceChangedEvent* event = (XIDeviceChangedEvent*) cookie->data;
+        handle_device_changed(loop, event->deviceid, event->reason);
+        break;
+    }
+    case XI_RawMotion:
+    {
+        XIRawEvent* raw_event = (XIRawEvent*) cookie->data;
+        double delta_x, delta_y;
+        get_raw_motion_deltas(raw_event, &delta_x, &delta_y);
+        handle_raw_motion(loop, raw_event->deviceid, raw_event->sourceid, raw_event->time, delta_x, delta_y);
+        break;
+    }
+    }
+}
+
+static enum XTrafficCause get_event_cause(XEvent* ev, struct EventLoop* loop)
+{
+    XGenericEventCookie* cookie = &ev->xcookie;
+    if (cookie->type != GenericEvent || cookie->extension != loop->xi_opcode) return X_CAUSE_OTHER_EVENT;
+    if (cookie->evtype == XI_RawMotion) return X_CAUSE_RAW_MOTION;
+    if (cookie->evtype == XI_KeyPress || cookie->evtype == XI_KeyRelease) return X_CAUSE_KEY;
+    return X_CAUSE_OTHER_EVENT;
+}
 
-    Display* display = open_display_or_exit();
-    int xi_opcode = ensure_xinput2_or_exit(display);
+static void handle_event(XEvent* ev, struct EventLoop* loop)
+{
+    XGenericEventCookie* cookie = &ev->xcookie;
 
-    Window window = DefaultRootWindow(display);
-    request_to_receive_events(display, window);
+    if (loop->screen_saver_event_base != -1 && ev->type == loop->screen_saver_event_base + ScreenSaverNotify)
+    {
+        apply_motion_batch(loop);
+        handle_screen_saver_event(((XScreenSaverNotifyEvent*) ev)->state, loop->display, loop->window);
+        return;
+    }
 
-    int xtest_keyboard_device_id = find_input_device_id_by_name(display, "Virtual core XTEST keyboard");
-    if (xtest_keyboard_device_id == -1)
-        logg(LOG_WARN, "could not find 'Virtual core XTEST keyboard'. Things might not work well.");
+    if (cookie->type != GenericEvent ||
+            cookie->extension != loop->xi_opcode ||
+            !XGetEventData(loop->display, cookie))
+        return;
 
-    struct ScreenPoint start_pointer_pos = get_pointer_position(display, window);
+    handle_xi_event(cookie, loop);
 
-    // vars for keeping track of accumulated pointer movement over time. Helps to decide when to scroll and how much.
-    double total_movement_y_delta = 0;
-    double total_movement_x_delta = 0;
+    XFreeEventData(loop->display, cookie);
+}
+#endif
 
-    while(1) {
+#ifdef USE_XCB
+// the axis values of a raw event are packed for the axes set in its mask, picks those of axis 0 and 1
+static void get_xcb_raw_motion_deltas(xcb_input_raw_motion_event_t* event, double* delta_x, double* delta_y)
+{
+    uint32_t* mask = xcb_input_raw_button_press_valuator_mask(event);
+    xcb_input_fp3232_t* values = xcb_input_raw_button_press_axisvalues_raw(event);
+    *delta_x = 0;
+    *delta_y = 0;
+    if (event->valuators_len == 0) return;
+
+    int value_index = 0;
+    for (int axis = 0; axis < 2; axis++)
+    {
+        if (!(mask[0] & (1u << axis))) continue;
+        double value = values[value_index].integral + values[value_index].frac / 4294967296.0;
+        value_index++;
+        if (axis == 0)
+            *delta_x = value;
+        else
+            *delta_y = value;
+    }
+}
+
+static enum XTrafficCause get_xcb_event_cause(xcb_generic_event_t* ev, struct EventLoop* loop)
+{
+    xcb_ge_generic_event_t* generic_event = (xcb_ge_generic_event_t*) ev;
+    if ((ev->response_type & 0x7f) != XCB_GE_GENERIC || generic_event->extension != loop->xi_opcode) return X_CAUSE_OTHER_EVENT;
+    if (generic_event->event_type == XCB_INPUT_RAW_MOTION) return X_CAUSE_RAW_MOTION;
+    if (generic_event->event_type == XCB_INPUT_KEY_PRESS || generic_event->event_type == XCB_INPUT_KEY_RELEASE) return X_CAUSE_KEY;
+    return X_CAUSE_OTHER_EVENT;
+}
+
+// handle_event() for XCB: the XI2 events are used as they came off the wire, without Xlib's conversion and copy
+static void handle_xcb_event(xcb_generic_event_t* ev, struct EventLoop* loop)
+{
+    uint8_t type = ev->response_type & 0x7f;
+    if (loop->screen_saver_event_base != -1 && type == loop->screen_saver_event_base + ScreenSaverNotify)
+    {
+        apply_motion_batch(loop);
+        handle_screen_saver_event(((xcb_screensaver_notify_event_t*) ev)->state, loop->display, loop->window);
+        return;
+    }
+
+    xcb_ge_generic_event_t* generic_event = (xcb_ge_generic_event_t*) ev;
+    if (type != XCB_GE_GENERIC || generic_event->extension != loop->xi_opcode)
+        return;
+
+    // keep the order of motion and key events: motion before a (de)activation belongs to the previous mode
+    if (generic_event->event_type != XCB_INPUT_RAW_MOTION)
+        apply_motion_batch(loop);
+
+    switch (generic_event->event_type) {
+    case XCB_INPUT_KEY_PRESS:
+    {
+        xcb_input_key_press_event_t* event = (xcb_input_key_press_event_t*) ev;
+        track_pointer_position(loop, event->root_x >> 16, event->root_y >> 16); // 16.16 fixed point
+        if (event->sourceid != loop->xtest_keyboard_device_id)
+            handle_key_press(loop, (int) event->detail, (int) event->mods.base,
+                             (event->flags & XCB_INPUT_KEY_EVENT_FLAGS_KEY_REPEAT) != 0, event->time);
+        break;
+    }
+    case XCB_INPUT_KEY_RELEASE:
+    {
+        xcb_input_key_release_event_t* event = (xcb_input_key_release_event_t*) ev;
+        track_pointer_position(loop, event->root_x >> 16, event->root_y >> 16);
+        if (event->sourceid != loop->xtest_keyboard_device_id)
+            handle_key_release(loop, (int) event->detail, event->time);
+        break;
+    }
+    case XCB_INPUT_HIERARCHY:
+    {
+        xcb_input_hierarchy_event_t* event = (xcb_input_hierarchy_event_t*) ev;
+        xcb_input_hierarchy_info_t* infos = xcb_input_hierarchy_infos(event);
+        int num_infos = xcb_input_hierarchy_infos_length(event);
+        for (int i = 0; i < num_infos; i++)
+        {
+            handle_device_hierarchy_change(loop, infos[i].deviceid, (int) infos[i].flags, infos[i].attachment,
+                                           infos[i].enabled);
+        }
+        handle_hierarchy_changed(loop);
+        break;
+    }
+    case XCB_INPUT_DEVICE_CHANGED:
+    {
+        xcb_input_device_changed_event_t* event = (xcb_input_device_changed_event_t*) ev;
+        handle_device_changed(loop, event->deviceid, event->reason);
+        break;
+    }
+    case XCB_INPUT_RAW_MOTION:
+    {
+        xcb_input_raw_motion_event_t* event = (xcb_input_raw_motion_event_t*) ev;
+        double delta_x, delta_y;
+        get_xcb_raw_motion_deltas(event, &delta_x, &delta_y);
+        handle_raw_motion(loop, event->deviceid, event->sourceid, event->time, delta_x, delta_y);
+        break;
+    }
+    }
+}
+#endif
+
+// True if events were read from the connection already, they wouldn't wake up epoll
+static Bool has_queued_x_events(struct EventLoop* loop)
+{
+#ifdef USE_XCB
+    if (loop->queued_event == NULL)
+        loop->queued_event = xcb_poll_for_queued_event(loop->connection);
+    return loop->queued_event != NULL;
+#else
+    return XQLength(loop->display) > 0;
+#endif
+}
+
+// handles all X events that arrived, returns their number
+static unsigned long drain_x_events(struct EventLoop* loop)
+{
+    unsigned long num_events = 0;
+#ifdef USE_XCB
+    xcb_generic_event_t* ev = loop->queued_event != NULL ? loop->queued_event : xcb_poll_for_event(loop->connection);
+    loop->queued_event = NULL;
+    while (ev != NULL)
+    {
+        struct XTraffic before = get_x_traffic(loop->display);
+        handle_xcb_event(ev, loop);
+        count_x_event_traffic(loop->display, get_xcb_event_cause(ev, loop), before);
+        free(ev);
+        num_events++;
+        ev = xcb_poll_for_event(loop->connection);
+    }
+#else
+    while (XEventsQueued(loop->display, QueuedAfterReading) > 0)
+    {
         XEvent ev;
-        XGenericEventCookie* cookie = &ev.xcookie;
+        XNextEvent(loop->display, &ev);
+        struct XTraffic before = get_x_traffic(loop->display);
+        handle_event(&ev, loop);
+        count_x_event_traffic(loop->display, get_event_cause(&ev, loop), before);
+        num_events++;
+    }
+#endif
+    return num_events;
+}
+
+static void flush_x_output(struct EventLoop* loop)
+{
+#ifdef USE_XCB
+    xcb_flush(loop->connection);
+#else
+    XFlush(loop->display);
+#endif
+}
 
-        XNextEvent(display, &ev);
+static void on_evdev_motion(void* data, int source_index, double delta_x, double delta_y, int64_t time_us)
+{
+    struct EventLoop* loop = (struct EventLoop*) data;
+    struct StatsPageDevice* page_device = count_received_motion(source_index);
+    PROBE2(raw_motion, source_index, (unsigned long) (time_us / 1000));
+    if (!scroll_core.is_active)
+    {
+        count_ignored_motion(page_device);
+        return;
+    }
+
+    if (recording != NULL)
+    {
+        // replayed like XInput2 raw motion, with the device as its own source
+        struct TraceEvent event = { .type = TRACE_MOTION, .time = (EventTime) (time_us / 1000), .device_id = source_index,
+                                    .source_id = source_index, .delta_x = delta_x, .delta_y = delta_y };
+        trace_write(recording, &event);
+    }
+
+    stats.raw_motion_events++;
+    stats.raw_motion_reports++;
+    flight_record(flight_recorder, (EventTime) (time_us / 1000), FLIGHT_RAW_MOTION, 0, source_index, delta_x, delta_y);
+    record_input_latency(monotonic_ns() / 1000 - time_us);
+    add_to_motion_batch(loop, source_index, delta_x, delta_y, (EventTime) (time_us / 1000), time_us);
+}
+
+static void on_evdev_key(void* data, int key_code, int modifiers, int is_press, int is_repeat, int64_t time_us)
+{
+    struct EventLoop* loop = (struct EventLoop*) data;
+
+    // keep the order of motion and key events, as for XInput2
+    apply_motion_batch(loop);
+    if (is_press)
+        handle_key_press(loop, key_code, modifiers, is_repeat, (EventTime) (time_us / 1000));
+    else
+        handle_key_release(loop, key_code, (EventTime) (time_us / 1000));
+}
+
+static void open_evdev_inputs_or_exit(struct Config* cfg)
+{
+    for (int i = 0; i < cfg->num_evdev_device_paths; i++)
+    {
+        struct EvdevSource* source = open_evdev_device(cfg->evdev_device_paths[i]);
+        if (source == NULL)
+            exit(-3);
+        evdev_inputs[num_evdev_inputs] = (struct EvdevInput) { .source = source, .index = num_evdev_inputs };
+        num_evdev_inputs++;
+    }
+}
 
-        if (cookie->type != GenericEvent ||
-                cookie->extension != xi_opcode ||
-                !XGetEventData(display, cookie))
+// reads everything pending on the evdev devices. Returns the number of events
+static unsigned long drain_evdev_inputs(struct EventLoop* loop)
+{
+    struct EvdevCallbacks callbacks = { .on_motion = on_evdev_motion, .on_key = on_evdev_key, .data = loop };
+    unsigned long num_events = 0;
+    for (int i = 0; i < num_evdev_inputs; i++)
+    {
+        struct EvdevInput* input = &evdev_inputs[i];
+        if (input->source->fd == -1) continue; // gone
+        int n = evdev_read_pending(input, &callbacks);
+        if (n == -1)
+        {
+            logg(LOG_ERROR, "%s is gone: %s\n", input->source->name, strerror(errno));
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, input->source->fd, NULL);
+            close(input->source->fd);
+            input->source->fd = -1;
             continue;
+        }
+        num_events += (unsigned long) n;
+    }
+    return num_events;
+}
 
-        switch (cookie->evtype) {
-        case XI_KeyPress:
+// the core whose held back movement is due first, NULL if none holds any back
+static struct ScrollCore* get_next_backlog_scroll_core()
+{
+    struct ScrollCore* cores[MAX_INPUT_DEVICES + 1];
+    int num_cores = get_scroll_cores(cores);
+    struct ScrollCore* next = NULL;
+    int next_delay_ms = 0;
+    for (int i = 0; i < num_cores; i++)
+    {
+        if (!scroll_core_has_backlog(cores[i])) continue;
+        int delay_ms = scroll_core_next_backlog_release_delay_ms(cores[i]);
+        if (next == NULL || delay_ms < next_delay_ms)
         {
-            XIDeviceEvent* event = (XIDeviceEvent*) cookie->data;
-            int key_code = event->detail;
-            Bool is_repeat = event->flags & XIKeyRepeat;
-            if (cfg.show_debug_output)
-                logg(LOG_DEBUG, "KeyPress: key_code %d, mods %d, is_repeat %d\n", key_code, event->mods.base, is_repeat);
-
-            if (event->deviceid != xtest_keyboard_device_id
-                    && is_trigger_shortcut(key_code, event->mods.base, &cfg)
-                    && !is_repeat)
-            {
-                if (cfg.is_toggle_mode_on)
-                {
-                    set_is_active(!is_active, display, window);
-                }
-                else if (!is_active)
-                {
-                    set_is_active(True, display, window);
-                }
+            next = cores[i];
+            next_delay_ms = delay_ms;
+        }
+    }
+    return next;
+}
 
-                if (is_active)
-                    start_pointer_pos = get_pointer_position(display, window);
-            }
+static void on_backlog_timer(void* data)
+{
+    (void) data;
+    // no new motion came in to scroll the held back movement, do it now. The loop plans the next release
+    struct ScrollCore* core = get_next_backlog_scroll_core();
+    if (core != NULL)
+        scroll_core_release_backlog(core);
+}
+
+static void on_stats_timer(void* data)
+{
+    struct EventLoop* loop = (struct EventLoop*) data;
+    loop->has_reported_stats = True;
+    if (loop->cfg->show_stats)
+        report_stats(loop->display);
+    report_latency(loop->cfg->show_stats);
+    timer_start(&loop->timers, &loop->stats_timer, STATS_REPORT_INTERVAL_MS * 1000000LL, STATS_REPORT_SLACK_NS);
+}
+
+// keep a timer running while the pacers hold back movement, so it is scrolled even when no more motion comes in
+static void schedule_backlog_release(struct EventLoop* loop)
+{
+    // leaving scrolling mode discards the backlog
+    struct ScrollCore* core = get_next_backlog_scroll_core();
+    if (core == NULL)
+    {
+        timer_cancel(&loop->timers, &loop->backlog_timer);
+        return;
+    }
+    if (loop->backlog_timer.is_armed) return; // tokens only grow, the planned time is still right
+
+    int64_t delay_ms = scroll_core_next_backlog_release_delay_ms(core);
+    timer_start(&loop->timers, &loop->backlog_timer, delay_ms * 1000000LL, BACKLOG_RELEASE_SLACK_NS);
+}
+
+// signals are received through a signalfd, so they are handled in the loop like any event.
+// blocked before any thread is started, the threads inherit the mask and leave the signals to the loop.
+static int block_signals_or_exit()
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    int fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1)
+    {
+        logg(LOG_FATAL, "failed to create signalfd: %s\n", strerror(errno));
+        exit(-6);
+    }
+    return fd;
+}
+
+// into the private runtime directory of the user if there is one, /tmp is shared
+static void dump_flight_recorder()
+{
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    if (dir == NULL || dir[0] == '\0')
+        dir = "/tmp";
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, FLIGHT_RECORDER_DUMP_NAME);
+    flight_recorder_dump(flight_recorder, path);
+}
+
+static void handle_signals(struct EventLoop* loop)
+{
+    struct signalfd_siginfo info;
+    while (read(loop->signal_fd, &info, sizeof(info)) == sizeof(info))
+    {
+        switch (info.ssi_signo)
+        {
+        case SIGUSR1:
+            report_stats(loop->display);
+            report_latency(True);
+            break;
+        case SIGUSR2:
+            if (flight_recorder != NULL)
+                dump_flight_recorder();
+            else
+                logg(LOG_WARN, "the flight recorder is off\n");
+            break;
+        case SIGINT:
+        case SIGTERM:
+            logg(LOG_INFO, "exiting\n");
+            set_is_active(False, loop->display, loop->window); // show the cursor again, remove barriers
+            if (loop->display != NULL)
+                XFlush(loop->display);
+            exit(0);
+        }
+    }
+}
+
+static void add_to_epoll_or_exit(int epoll_fd, int fd, enum EventSource source)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = source };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        logg(LOG_FATAL, "failed to watch fd %d: %s\n", fd, strerror(errno));
+        exit(-6);
+    }
+}
+
+static void init_event_sources_or_exit(struct EventLoop* loop)
+{
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1 || timer_set_init(&loop->timers) != 0)
+    {
+        logg(LOG_FATAL, "failed to set up the event loop: %s\n", strerror(errno));
+        exit(-6);
+    }
+    if (loop->display != NULL)
+        add_to_epoll_or_exit(loop->epoll_fd, ConnectionNumber(loop->display), SOURCE_X);
+    for (int i = 0; i < num_evdev_inputs; i++)
+        add_to_epoll_or_exit(loop->epoll_fd, evdev_inputs[i].source->fd, SOURCE_EVDEV);
+    add_to_epoll_or_exit(loop->epoll_fd, loop->timers.fd, SOURCE_TIMERS);
+    add_to_epoll_or_exit(loop->epoll_fd, loop->signal_fd, SOURCE_SIGNALS);
+
+    loop->backlog_timer = (struct Timer) { .callback = on_backlog_timer, .data = loop };
+    loop->stats_timer = (struct Timer) { .callback = on_stats_timer, .data = loop };
+    loop->motion_stop_timer = (struct Timer) { .callback = on_motion_stop_timer, .data = loop };
+    loop->kinetic_timer = (struct Timer) { .callback = on_kinetic_timer, .data = loop };
+}
+
+// sleeps until the X connection, an evdev device, a timer or a signal needs attention. Timers and signals are handled here,
+// X and evdev events are left to the caller. Returns True if only the stats timer woke it up
+static Bool wait_for_events(struct EventLoop* loop)
+{
+    struct epoll_event events[3 + MAX_EVDEV_DEVICES];
+    int num_events;
+    do
+    {
+        num_events = epoll_wait(loop->epoll_fd, events, 3 + MAX_EVDEV_DEVICES, -1);
+    } while (num_events == -1 && errno == EINTR);
+
+    Bool is_stats_only = True;
+    loop->has_reported_stats = False;
+    for (int i = 0; i < num_events; i++)
+    {
+        switch ((enum EventSource) events[i].data.u32)
+        {
+        case SOURCE_TIMERS:
+            if (timer_set_run_expired(&loop->timers) != 1 || !loop->has_reported_stats)
+                is_stats_only = False;
+            break;
+        case SOURCE_SIGNALS:
+            is_stats_only = False;
+            handle_signals(loop);
+            break;
+        case SOURCE_EVDEV:
+            is_stats_only = False;
+            loop->is_evdev_readable = True;
+            break;
+        case SOURCE_X:
+            is_stats_only = False;
             break;
         }
-        case XI_KeyRelease:
+    }
+    return is_stats_only;
+}
+
+static EventTime replay_clock_now(void* data)
+{
+    return *(EventTime*) data;
+}
+
+static void print_replayed_scroll(void* data, enum ScrollDirection direction, double clicks)
+{
+    printf("%u scroll %s %g\n", *(EventTime*) data, direction == SCROLL_VERTICAL ? "v" : "h", clicks);
+}
+
+static void print_replayed_key_release(void* data, unsigned int key_code)
+{
+    printf("%u release key %u\n", *(EventTime*) data, key_code);
+}
+
+// scrolls the backlog the timer would have released up to the given time
+static void release_replayed_backlog(EventTime* now, EventTime until)
+{
+    struct ScrollCore* core;
+    while ((core = get_next_backlog_scroll_core()) != NULL)
+    {
+        int delay_ms = scroll_core_next_backlog_release_delay_ms(core);
+        if ((int32_t) (until - *now) < delay_ms) return;
+        *now += (EventTime) delay_ms;
+        scroll_core_release_backlog(core);
+    }
+}
+
+// a pointer device as it was when recorded: its motion gets the same scale, and the profile of its name
+static void replay_device(struct TraceEvent* event, struct Config* cfg)
+{
+    Bool is_known = find_input_device(&input_devices, event->device_id) != NULL;
+    struct InputDevice* device = set_recorded_input_device(&input_devices, event->device_id, event->device_name, event->counts_per_mm);
+    if (device == NULL) return;
+    logg(LOG_DEBUG, "replayed device %d '%s' has %g x %g counts per mm\n", device->id, device->name,
+         device->counts_per_mm[0], device->counts_per_mm[1]);
+    if (!is_known)
+    {
+        set_up_device_scroll_core(device, cfg);
+        return;
+    }
+    set_device_motion_scale(device, cfg);
+    scroll_core_discard_backlog(&device->core); // movement in the old units
+}
+
+// feeds a trace through the same handlers as live input, one event per drain, without X.
+// the scrolls are printed instead of sent. Returns the exit code.
+static int replay_trace(struct Config* cfg)
+{
+    struct TraceReader reader;
+    if (trace_reader_open(&reader, cfg->replay_path) != 0)
+        return 1;
+
+    struct EventLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.cfg = cfg;
+    loop.xtest_keyboard_device_id = -1;
+    cfg->pointer_fixation = FIXATE_BY_GRABBING; // nothing to hold in place
+    device_selection.use_master_pointers = True; // the trace only has what was selected when recording
+    if (cfg->kinetic_time_constant_ms > 0)
+    {
+        logg(LOG_WARN, "kinetic scrolling needs the timers of the event loop, it is not replayed\n");
+        cfg->kinetic_time_constant_ms = 0;
+    }
+
+    EventTime now = 0;
+    struct ScrollSink sink = { .scroll = print_replayed_scroll, .release_key = print_replayed_key_release, .data = &now };
+    struct ScrollClock clock = { .now = replay_clock_now, .data = &now };
+    init_scroll_core(&loop, cfg->output_type != OUTPUT_XTEST, sink, clock);
+
+    unsigned long num_events = 0;
+    EventTime first_time = 0;
+    int64_t start_ns = monotonic_ns();
+    struct TraceEvent event;
+    int rc;
+    while ((rc = trace_read(&reader, &event)) == 1)
+    {
+        if (num_events == 0)
+            first_time = now = event.time;
+        release_replayed_backlog(&now, event.time);
+        now = event.time;
+
+        if (cfg->replay_in_real_time)
         {
-            if (!cfg.is_toggle_mode_on)
+            int64_t due_ns = start_ns + (int64_t) (EventTime) (event.time - first_time) * 1000000;
+            int64_t wait_ns = due_ns - monotonic_ns();
+            if (wait_ns > 0)
             {
-                XIDeviceEvent* event = (XIDeviceEvent*) cookie->data;
-                int key_code = event->detail;
-                logg(LOG_DEBUG, "KeyRelease: key_code %d, mods %d\n", key_code, event->mods.base);
-                if (event->deviceid != xtest_keyboard_device_id
-                        && is_active
-                        && is_trigger_shortcut(key_code, 0, &cfg))
-                {
-                    set_is_active(False, display, window);
-                }
+                struct timespec wait = { .tv_sec = wait_ns / 1000000000, .tv_nsec = wait_ns % 1000000000 };
+                nanosleep(&wait, NULL);
             }
-            break;
         }
-        case XI_ButtonPress:
+
+        switch (event.type)
+        {
+        case TRACE_MOTION:
+            handle_raw_motion(&loop, event.device_id, event.source_id, event.time, event.delta_x, event.delta_y);
             break;
-        case XI_RawMotion:
-            if (!is_active)
-                break;
+        case TRACE_KEY_PRESS:
+            apply_motion_batch(&loop);
+            handle_key_press(&loop, event.key_code, event.modifiers, event.is_repeat, event.time);
+            break;
+        case TRACE_KEY_RELEASE:
+            apply_motion_batch(&loop);
+            handle_key_release(&loop, event.key_code, event.time);
+            break;
+        case TRACE_DEVICE:
+            apply_motion_batch(&loop);
+            replay_device(&event, cfg);
+            break;
+        }
+        apply_motion_batch(&loop);
+        num_events++;
+    }
+    release_replayed_backlog(&now, now + SCROLL_BACKLOG_LIMIT_MS * 2);
+    double elapsed_s = (monotonic_ns() - start_ns) / 1e9;
+    trace_reader_close(&reader);
+
+    if (rc == -1)
+        fprintf(stderr, "the trace is malformed after %lu events\n", num_events);
+    fprintf(stderr, "replayed %lu events (%u ms of input) in %.3f s, %.0f events/s, %lu scrolls, %lu rate limited decisions\n",
+            num_events, (EventTime) (now - first_time), elapsed_s, elapsed_s > 0 ? num_events / elapsed_s : 0.0,
+            get_scroll_stats().scrolls, get_scroll_stats().rate_limited_decisions);
+    return rc == -1 ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct Config cfg = create_default_config();
+    parse_args_into_config(argc, argv, &cfg);
+
+    if (cfg.show_debug_output)
+        print_cfg(&cfg);
+
+    if (cfg.replay_path != NULL)
+    {
+        if (log_start(cfg.binary_log_path) != 0)
+            exit(-1);
+        exit(replay_trace(&cfg));
+    }
 
-            /// fixate pointer (set pointer to start pos): not the best solution (is wiggles a bit)
-            XWarpPointer(display, None, window, 0, 0, 0, 0,
-                         start_pointer_pos.x, start_pointer_pos.y);
+    ensure_single_instance_or_exit();
 
-            /// update total movement deltas and check if we need to scroll
-            XIRawEvent* raw_event = (XIRawEvent*) cookie->data;
-            double deltaX = raw_event->raw_values[0];
-            double deltaY = raw_event->raw_values[1];
+    struct EventLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.cfg = &cfg;
+    loop.signal_fd = block_signals_or_exit();
 
-            check_for_scroll_trigger(SCROLL_VERTICAL, &total_movement_y_delta, deltaY, &cfg, display);
-            if (cfg.allow_horizontal_scroll)
-                check_for_scroll_trigger(SCROLL_HORIZONTAL, &total_movement_x_delta, deltaX, &cfg, display);
+    if (log_start(cfg.binary_log_path) != 0)
+        exit(-1);
 
-            break;
+    if (cfg.trigger_key_code == UNSPECIFIED_KEY_CODE)
+        logg(LOG_WARN, "warning: no trigger key code was specified\n");
+
+    XInitThreads(); // the emitter thread uses Xlib too, although on its own connection
+
+    open_evdev_inputs_or_exit(&cfg);
+    if (num_evdev_inputs > 0)
+        cfg.pointer_fixation = FIXATE_BY_GRABBING;
+    clock_gettime(CLOCK_MONOTONIC, &stats.last_report_time);
+
+    // evdev input with an output that doesn't need X can do without it, e.g. on the console
+    Bool needs_display = num_evdev_inputs == 0 || cfg.output_type == OUTPUT_XTEST;
+    Display* display = loop.display = needs_display ? open_display_or_exit() : XOpenDisplay(NULL);
+    if (display == NULL)
+        logg(LOG_INFO, "no X display, running without X\n");
+    if (display != NULL)
+    {
+        watch_x_traffic(display);
+#ifdef USE_XCB
+        // events are read with XCB from here on, Xlib is still used for the setup and the rare requests
+        XSetEventQueueOwner(display, XCBOwnsEventQueue);
+        loop.connection = XGetXCBConnection(display);
+#endif
+        Window window = loop.window = DefaultRootWindow(display);
+        loop.screen_saver_event_base = request_to_receive_screen_saver_events(display, window);
+        stats.x_requests_at_report = XNextRequest(display) - 1;
+    }
+    if (num_evdev_inputs == 0)
+    {
+        Window window = loop.window;
+        loop.xi_opcode = ensure_xinput2_or_exit(display);
+        ensure_pointer_fixation_supported(display, &cfg);
+
+        load_input_devices(&input_devices, display);
+        resolve_pointer_devices(&cfg);
+        request_to_receive_events(display, window, False);
+
+        struct InputDevice* xtest_keyboard = find_input_device_by_name(&input_devices, "Virtual core XTEST keyboard");
+        loop.xtest_keyboard_device_id = xtest_keyboard != NULL ? xtest_keyboard->id : -1;
+        if (loop.xtest_keyboard_device_id == -1)
+            logg(LOG_WARN, "could not find 'Virtual core XTEST keyboard'. Things might not work well.");
+    }
+
+    start_emitter_or_exit(display != NULL ? open_display_or_exit() : NULL, &cfg);
+    struct ScrollSink sink = { .scroll = trigger_scroll, .release_key = release_key, .data = NULL };
+    struct ScrollClock clock = { .now = scroll_clock_now, .data = &loop };
+    init_scroll_core(&loop, emitter.output->has_high_resolution, sink, clock);
+
+    if (cfg.flight_recorder_s > 0)
+    {
+        static struct FlightRecorder recorder;
+        if (flight_recorder_init(&recorder, cfg.flight_recorder_s) == 0)
+            flight_recorder = scroll_core.recorder = &recorder;
+    }
+    set_up_device_scroll_cores(&cfg);
+
+    if (cfg.record_path != NULL)
+    {
+        static struct TraceWriter writer;
+        if (trace_writer_open(&writer, cfg.record_path) != 0)
+            exit(-1);
+        recording = &writer; // flushed by exit()
+    }
+
+    char stats_page_path[STATS_PAGE_PATH_SIZE];
+    stats_page_default_path(stats_page_path);
+    struct StatsPage* shared_stats_page = stats_page_create(stats_page_path);
+    if (shared_stats_page != NULL)
+        stats_page = shared_stats_page;
+
+    if (cfg.latency_json_path != NULL)
+    {
+        latency_report.json = strcmp(cfg.latency_json_path, "-") == 0 ? stdout : fopen(cfg.latency_json_path, "a");
+        if (latency_report.json == NULL)
+        {
+            logg(LOG_FATAL, "could not open %s: %s\n", cfg.latency_json_path, strerror(errno));
+            exit(-1);
+        }
+    }
+
+    init_event_sources_or_exit(&loop);
+    if (cfg.show_stats || latency_report.json != NULL)
+        timer_start(&loop.timers, &loop.stats_timer, STATS_REPORT_INTERVAL_MS * 1000000LL, STATS_REPORT_SLACK_NS);
+
+    if (display != NULL)
+    {
+        stats.x_traffic_at_iteration = get_x_traffic(display);
+        logg(LOG_INFO, "startup: %lu X requests, %lu round trips, %lu bytes written\n",
+             stats.x_traffic_at_iteration.requests, stats.x_traffic_at_iteration.round_trips, stats.x_traffic_at_iteration.bytes_written);
+    }
+
+    while(1) {
+        if (display != NULL)
+            count_x_iteration_traffic(display);
+
+        // Xlib may have read events into its queue while waiting for a reply, they wouldn't wake up epoll
+        Bool has_waited = False;
+        Bool is_stats_wakeup = False;
+        if (display == NULL || !has_queued_x_events(&loop))
+        {
+            if (display != NULL)
+                flush_x_output(&loop);
+            is_stats_wakeup = wait_for_events(&loop);
+            has_waited = True;
+        }
+
+        int64_t drain_start_ns = cfg.show_stats ? monotonic_ns() : 0;
+
+        // drain everything that arrived in the meantime, so a burst of motion costs one scroll decision, one warp and one flush
+        unsigned long batch_size = 0;
+        if (loop.is_evdev_readable)
+        {
+            loop.is_evdev_readable = False;
+            batch_size += drain_evdev_inputs(&loop);
+        }
+        if (display != NULL)
+            batch_size += drain_x_events(&loop);
+        apply_motion_batch(&loop);
+        if (!scroll_core.is_active && loop.kinetics.is_coasting)
+            stop_coasting(&loop);
+        schedule_backlog_release(&loop);
+        publish_emit_commands();
+        struct ScrollCoreStats scroll_stats = get_scroll_stats();
+        stats_page_set(&stats_page->rate_limited_decisions, scroll_stats.rate_limited_decisions);
+        stats_page_set(&stats_page->discarded_backlog_clicks, scroll_stats.discarded_backlog_clicks);
+
+        // the report's own wakeups aren't counted, so an idle process shows zero
+        if (has_waited && !(batch_size == 0 && is_stats_wakeup))
+        {
+            stats.wakeups++;
+            stats.wakeups_since_report++;
         }
-        fflush(stdout);
 
-        XFreeEventData(display, cookie);
+        if (batch_size == 0) continue; // woken up by a timer or signal
+        PROBE1(drain, batch_size);
+
+        stats.drained_events += batch_size;
+        stats.drains++;
+        if (cfg.show_stats)
+        {
+            unsigned long busy_ns = (unsigned long) (monotonic_ns() - drain_start_ns);
+            stats.busy_ns_total += busy_ns;
+            if (busy_ns > stats.busy_ns_max)
+                stats.busy_ns_max = busy_ns;
+        }
     }
 
     return 0;
 }
-
@@ -0,0 +1,298 @@
+// output backends, see output.h
+
+#include "output.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+#include <X11/extensions/XTest.h>
+#ifdef USE_XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xtest.h>
+#endif
+#include "log.h"
+
+#define UINPUT_MAX_PENDING_EVENTS 64
+#define UINPUT_MAX_EVENTS_PER_SCROLL 3 // hi-res wheel, legacy wheel, SYN_REPORT
+#define HIGH_RESOLUTION_UNITS_PER_CLICK 120 // REL_WHEEL_HI_RES units of one wheel detent
+
+enum ScrollDirectionLinuxButtons
+{
+    SCROLL_UP = 4,
+    SCROLL_DOWN = 5,
+    SCROLL_LEFT = 6,
+    SCROLL_RIGHT = 7
+};
+
+struct XTestOutput {
+    struct OutputBackend base;
+    Display* display;
+};
+
+struct UinputOutput {
+    struct OutputBackend base;
+    Display* display; // for releasing keys, that must come from the X side of things
+    int fd;
+    // fractions of a high resolution unit not sent yet, per axis
+    double remainder_v;
+    double remainder_h;
+    // high resolution units since the last legacy REL_WHEEL/REL_HWHEEL click, for clients that only know those
+    int legacy_units_v;
+    int legacy_units_h;
+    // written with one write() per flush
+    struct input_event pending[UINPUT_MAX_PENDING_EVENTS];
+    int num_pending;
+};
+
+struct FakeOutput {
+    struct OutputBackend base;
+    struct FakeOutputEvent events[FAKE_OUTPUT_CAPACITY]; // ring
+    unsigned long num_events; // ever captured
+    unsigned long num_taken;
+};
+
+// scroll wheel input in linux is modelled as (mouse) buttons presses
+// Button 4: (scrolls up), Button 5 (scrolls down)
+// Button 6 (scrolls left), Button 7 (scrolls right)
+static void xtest_scroll(struct OutputBackend* output, enum ScrollDirection direction, double clicks)
+{
+    struct XTestOutput* xtest = (struct XTestOutput*) output;
+
+    unsigned int negative_scroll_amount_btn = direction == SCROLL_VERTICAL ? SCROLL_UP : SCROLL_LEFT;
+    unsigned int postitive_scroll_amount_btn = direction == SCROLL_VERTICAL ? SCROLL_DOWN : SCROLL_RIGHT;
+    unsigned int scroll_button = clicks < 0 ? negative_scroll_amount_btn : postitive_scroll_amount_btn;
+
+    int num_clicks = (int) fabs(clicks);
+    for (int i = 0; i < num_clicks; i++)
+    {
+#ifdef USE_XCB
+        xcb_connection_t* connection = XGetXCBConnection(xtest->display);
+        xcb_test_fake_input(connection, XCB_BUTTON_PRESS, (uint8_t) scroll_button, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+        xcb_test_fake_input(connection, XCB_BUTTON_RELEASE, (uint8_t) scroll_button, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+#else
+        // XSendEvent doesn't seem to work, so XTestFakeButtonEvent is used
+        XTestFakeButtonEvent(xtest->display, scroll_button, 1, CurrentTime); // "button" down
+        XTestFakeButtonEvent(xtest->display, scroll_button, 0, CurrentTime); // "button" up
+#endif
+    }
+}
+
+static void xtest_release_key(struct OutputBackend* output, unsigned int x_key_code)
+{
+    struct XTestOutput* xtest = (struct XTestOutput*) output;
+#ifdef USE_XCB
+    xcb_test_fake_input(XGetXCBConnection(xtest->display), XCB_KEY_RELEASE, (uint8_t) x_key_code, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+#else
+    XTestFakeKeyEvent(xtest->display, x_key_code, False, 0);
+#endif
+}
+
+static void xtest_flush(struct OutputBackend* output)
+{
+    struct XTestOutput* xtest = (struct XTestOutput*) output;
+#ifdef USE_XCB
+    xcb_flush(XGetXCBConnection(xtest->display));
+#else
+    XFlush(xtest->display);
+#endif
+}
+
+static void uinput_flush(struct OutputBackend* output)
+{
+    struct UinputOutput* uinput = (struct UinputOutput*) output;
+    if (uinput->num_pending == 0) return;
+
+    ssize_t size = (ssize_t) (uinput->num_pending * sizeof(struct input_event));
+    if (write(uinput->fd, uinput->pending, (size_t) size) != size)
+        logg(LOG_ERROR, "uinput output: write failed: %s\n", strerror(errno));
+    uinput->num_pending = 0;
+}
+
+// the caller made room for it
+static void uinput_queue_event(struct UinputOutput* uinput, unsigned short type, unsigned short code, int value)
+{
+    struct input_event* ev = &uinput->pending[uinput->num_pending++];
+    memset(ev, 0, sizeof(*ev));
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+}
+
+static void uinput_scroll(struct OutputBackend* output, enum ScrollDirection direction, double clicks)
+{
+    struct UinputOutput* uinput = (struct UinputOutput*) output;
+    Bool is_vertical = direction == SCROLL_VERTICAL;
+
+    // evdev wheels count positive for up and right
+    double units = (is_vertical ? -clicks : clicks) * HIGH_RESOLUTION_UNITS_PER_CLICK;
+    double* remainder = is_vertical ? &uinput->remainder_v : &uinput->remainder_h;
+    units += *remainder;
+    int whole_units = (int) units;
+    *remainder = units - whole_units;
+    if (whole_units == 0) return;
+
+    // a batch can hold more scrolls than fit, write out what's pending rather than drop any. The units were
+    // counted already, and a report must not be left without its SYN_REPORT
+    if (uinput->num_pending + UINPUT_MAX_EVENTS_PER_SCROLL > UINPUT_MAX_PENDING_EVENTS)
+        uinput_flush(output);
+    uinput_queue_event(uinput, EV_REL, is_vertical ? REL_WHEEL_HI_RES : REL_HWHEEL_HI_RES, whole_units);
+
+    int* legacy_units = is_vertical ? &uinput->legacy_units_v : &uinput->legacy_units_h;
+    *legacy_units += whole_units;
+    int legacy_clicks = *legacy_units / HIGH_RESOLUTION_UNITS_PER_CLICK;
+    if (legacy_clicks != 0)
+    {
+        *legacy_units -= legacy_clicks * HIGH_RESOLUTION_UNITS_PER_CLICK;
+        uinput_queue_event(uinput, EV_REL, is_vertical ? REL_WHEEL : REL_HWHEEL, legacy_clicks);
+    }
+    uinput_queue_event(uinput, EV_SYN, SYN_REPORT, 0);
+}
+
+static void uinput_release_key(struct OutputBackend* output, unsigned int x_key_code)
+{
+    struct UinputOutput* uinput = (struct UinputOutput*) output;
+    if (uinput->display == NULL) return; // no X, e.g. on the console: nothing to confuse with the held key
+    XTestFakeKeyEvent(uinput->display, x_key_code, False, 0);
+    XFlush(uinput->display); // before the scroll events, which don't go through X
+}
+
+static Bool setup_uinput_device(int fd)
+{
+    // a pointer needs motion axes and a button, or it is not taken for a mouse and its wheel is ignored
+    int rc = ioctl(fd, UI_SET_EVBIT, EV_KEY)
+            | ioctl(fd, UI_SET_KEYBIT, BTN_LEFT)
+            | ioctl(fd, UI_SET_EVBIT, EV_REL)
+            | ioctl(fd, UI_SET_RELBIT, REL_X)
+            | ioctl(fd, UI_SET_RELBIT, REL_Y)
+            | ioctl(fd, UI_SET_RELBIT, REL_WHEEL)
+            | ioctl(fd, UI_SET_RELBIT, REL_HWHEEL)
+            | ioctl(fd, UI_SET_RELBIT, REL_WHEEL_HI_RES)
+            | ioctl(fd, UI_SET_RELBIT, REL_HWHEEL_HI_RES);
+    if (rc < 0) return False;
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    snprintf(setup.name, sizeof(setup.name), "MouseMoveToScroll virtual wheel");
+    return ioctl(fd, UI_DEV_SETUP, &setup) == 0 && ioctl(fd, UI_DEV_CREATE) == 0;
+}
+
+static struct OutputBackend* create_uinput_output(Display* display)
+{
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+    {
+        logg(LOG_ERROR, "could not open /dev/uinput: %s. Is the user allowed to (e.g. in the input group)?\n", strerror(errno));
+        return NULL;
+    }
+    if (!setup_uinput_device(fd))
+    {
+        logg(LOG_ERROR, "could not create uinput device: %s\n", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    struct UinputOutput* uinput = calloc(1, sizeof(*uinput));
+    uinput->base = (struct OutputBackend)
+    {
+        .name = "uinput",
+        .has_high_resolution = True,
+        .scroll = uinput_scroll,
+        .release_key = uinput_release_key,
+        .flush = uinput_flush,
+    };
+    uinput->display = display;
+    uinput->fd = fd;
+    return &uinput->base;
+}
+
+static void fake_capture(struct FakeOutput* fake, struct FakeOutputEvent ev)
+{
+    fake->events[fake->num_events % FAKE_OUTPUT_CAPACITY] = ev;
+    fake->num_events++;
+}
+
+static void fake_scroll(struct OutputBackend* output, enum ScrollDirection direction, double clicks)
+{
+    logg(LOG_INFO, "output: scroll %s %g\n", direction == SCROLL_VERTICAL ? "v" : "h", clicks);
+    fake_capture((struct FakeOutput*) output,
+                 (struct FakeOutputEvent) { .type = FAKE_OUTPUT_SCROLL, .direction = direction, .clicks = clicks });
+}
+
+static void fake_release_key(struct OutputBackend* output, unsigned int x_key_code)
+{
+    logg(LOG_INFO, "output: release key %u\n", x_key_code);
+    fake_capture((struct FakeOutput*) output,
+                 (struct FakeOutputEvent) { .type = FAKE_OUTPUT_KEY_RELEASE, .x_key_code = x_key_code });
+}
+
+static void fake_flush(struct OutputBackend* output)
+{
+    fake_capture((struct FakeOutput*) output, (struct FakeOutputEvent) { .type = FAKE_OUTPUT_FLUSH });
+}
+
+int take_fake_output_events(struct OutputBackend* output, struct FakeOutputEvent* events, int max_events)
+{
+    struct FakeOutput* fake = (struct FakeOutput*) output;
+    if (fake->num_events - fake->num_taken > FAKE_OUTPUT_CAPACITY)
+        fake->num_taken = fake->num_events - FAKE_OUTPUT_CAPACITY;
+
+    int n = 0;
+    for (; n < max_events && fake->num_taken < fake->num_events; n++, fake->num_taken++)
+        events[n] = fake->events[fake->num_taken % FAKE_OUTPUT_CAPACITY];
+    return n;
+}
+
+struct OutputBackend* create_output_backend(enum OutputBackendType type, Display* display)
+{
+    switch (type)
+    {
+    case OUTPUT_XTEST:
+    {
+        struct XTestOutput* xtest = calloc(1, sizeof(*xtest));
+        xtest->base = (struct OutputBackend)
+        {
+            .name = "xtest",
+            .has_high_resolution = False,
+            .scroll = xtest_scroll,
+            .release_key = xtest_release_key,
+            .flush = xtest_flush,
+        };
+        xtest->display = display;
+        return &xtest->base;
+    }
+    case OUTPUT_UINPUT:
+        return create_uinput_output(display);
+    case OUTPUT_FAKE:
+    {
+        struct FakeOutput* fake = calloc(1, sizeof(*fake));
+        fake->base = (struct OutputBackend)
+        {
+            .name = "fake",
+            .has_high_resolution = True,
+            .scroll = fake_scroll,
+            .release_key = fake_release_key,
+            .flush = fake_flush,
+        };
+        return &fake->base;
+    }
+    }
+    return NULL;
+}
+
+const char* output_backend_type_name(enum OutputBackendType type)
+{
+    switch (type)
+    {
+    case OUTPUT_XTEST: return "xtest";
+    case OUTPUT_UINPUT: return "uinput";
+    case OUTPUT_FAKE: return "fake";
+    }
+    return "?";
+}
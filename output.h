@@ -0,0 +1,44 @@
+// output backends: how scrolling reaches the applications.
+// all calls come from the emitter thread. scroll() and release_key() may buffer, flush() sends everything.
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <X11/Xlib.h>
+#include "scrollcore.h"
+
+enum OutputBackendType
+{
+    OUTPUT_XTEST,  // wheel clicks as buttons 4-7 through XTest
+    OUTPUT_UINPUT, // high resolution wheel of a virtual input device, fractions of a click
+    OUTPUT_FAKE    // nothing is sent, the output is captured (and logged), for dry runs and replays
+};
+
+struct OutputBackend {
+    const char* name;
+    Bool has_high_resolution; // scroll() takes fractions of a click, else whole clicks only
+    // clicks < 0: up/left, > 0: down/right
+    void (*scroll)(struct OutputBackend* output, enum ScrollDirection direction, double clicks);
+    void (*release_key)(struct OutputBackend* output, unsigned int x_key_code);
+    void (*flush)(struct OutputBackend* output);
+};
+
+// what the fake backend captured
+struct FakeOutputEvent {
+    enum { FAKE_OUTPUT_SCROLL, FAKE_OUTPUT_KEY_RELEASE, FAKE_OUTPUT_FLUSH } type;
+    enum ScrollDirection direction;
+    double clicks;
+    unsigned int x_key_code;
+};
+
+#define FAKE_OUTPUT_CAPACITY 4096
+
+// display: connection used for XTest (also by the uinput backend for releasing keys, may be NULL for it). NULL on failure.
+struct OutputBackend* create_output_backend(enum OutputBackendType type, Display* display);
+const char* output_backend_type_name(enum OutputBackendType type);
+
+// events captured by a fake backend since the last call, at most FAKE_OUTPUT_CAPACITY (the oldest are lost).
+// returns the number copied into events
+int take_fake_output_events(struct OutputBackend* output, struct FakeOutputEvent* events, int max_events);
+
+#endif // OUTPUT_H
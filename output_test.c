@@ -0,0 +1,217 @@
+// the motion to scroll conversion driving the fake output backend, checked on the events it captured:
+// the threshold, repeated and single clicks, fractions of a click, and the key release before the first scroll
+
+#include <stdlib.h>
+#include "scrollcore.h"
+#include "output.h"
+#include "log.h"
+#include "test.h"
+
+static const int RELEASE_KEY_CODE = 37;
+
+static EventTime fake_now = 1000;
+
+static EventTime fake_clock_now(void* data)
+{
+    (void) data;
+    return fake_now;
+}
+
+static void sink_scroll(void* data, enum ScrollDirection direction, double clicks)
+{
+    struct OutputBackend* output = (struct OutputBackend*) data;
+    output->scroll(output, direction, clicks);
+}
+
+static void sink_release_key(void* data, unsigned int key_code)
+{
+    struct OutputBackend* output = (struct OutputBackend*) data;
+    output->release_key(output, key_code);
+}
+
+struct Fixture {
+    struct OutputBackend* output;
+    struct ScrollCore core;
+    struct FakeOutputEvent events[64];
+    int num_events;
+};
+
+static void set_up(struct Fixture* fixture, int has_high_resolution, int allow_repeated_scroll)
+{
+    fixture->output = create_output_backend(OUTPUT_FAKE, NULL);
+    struct ScrollCoreConfig cfg =
+    {
+        .threshold = 100,
+        .rate_limit = 1000,
+        .burst = 100,
+        .backlog_limit_ms = 500,
+        .allow_horizontal_scroll = 1,
+        .allow_repeated_scroll = allow_repeated_scroll,
+        .has_high_resolution = has_high_resolution,
+        .release_key_code = RELEASE_KEY_CODE,
+        .accel = NULL,
+    };
+    struct ScrollSink sink = { .scroll = sink_scroll, .release_key = sink_release_key, .data = fixture->output };
+    struct ScrollClock clock = { .now = fake_clock_now, .data = NULL };
+    scroll_core_init(&fixture->core, &cfg, sink, clock);
+    scroll_core_set_active(&fixture->core, 1);
+}
+
+static void tear_down(struct Fixture* fixture)
+{
+    free(fixture->output);
+}
+
+// one motion and the output of it, flushed like the emitter does after each drain
+static void move(struct Fixture* fixture, double delta_x, double delta_y)
+{
+    fake_now += 8;
+    scroll_core_add_motion(&fixture->core, delta_x, delta_y, fake_now);
+    fixture->output->flush(fixture->output);
+    fixture->num_events = take_fake_output_events(fixture->output, fixture->events, 64);
+}
+
+// the scrolls captured by the last move, flushes and key releases skipped
+static int scrolls(struct Fixture* fixture, struct FakeOutputEvent* scrolled, int max_scrolls)
+{
+    int n = 0;
+    for (int i = 0; i < fixture->num_events && n < max_scrolls; i++)
+    {
+        if (fixture->events[i].type == FAKE_OUTPUT_SCROLL)
+            scrolled[n++] = fixture->events[i];
+    }
+    return n;
+}
+
+static void test_threshold()
+{
+    struct Fixture fixture;
+    set_up(&fixture, 0, 1);
+    struct FakeOutputEvent scrolled[8];
+
+    move(&fixture, 0, 60);
+    CHECK(scrolls(&fixture, scrolled, 8) == 0);
+    move(&fixture, 0, 39);
+    CHECK(scrolls(&fixture, scrolled, 8) == 0);
+    // exactly a threshold's worth is not over it yet
+    move(&fixture, 0, 1);
+    CHECK(scrolls(&fixture, scrolled, 8) == 0);
+    move(&fixture, 0, 1);
+    CHECK(scrolls(&fixture, scrolled, 8) == 1);
+    CHECK(scrolled[0].direction == SCROLL_VERTICAL);
+    CHECK(scrolled[0].clicks == 1);
+
+    // up and left are negative
+    move(&fixture, -150, -150);
+    CHECK(scrolls(&fixture, scrolled, 8) == 2);
+    CHECK(scrolled[0].direction == SCROLL_VERTICAL && scrolled[0].clicks == -1);
+    CHECK(scrolled[1].direction == SCROLL_HORIZONTAL && scrolled[1].clicks == -1);
+
+    // nothing scrolls while inactive
+    scroll_core_set_active(&fixture.core, 0);
+    move(&fixture, 0, 1000);
+    CHECK(fixture.num_events == 1 && fixture.events[0].type == FAKE_OUTPUT_FLUSH);
+    tear_down(&fixture);
+}
+
+static void test_repeated_scroll()
+{
+    struct Fixture fixture;
+    set_up(&fixture, 0, 1);
+    struct FakeOutputEvent scrolled[8];
+
+    // a fast move scrolls as many clicks as it is worth, the rest stays for the next one
+    move(&fixture, 0, 350);
+    CHECK(scrolls(&fixture, scrolled, 8) == 1);
+    CHECK(scrolled[0].clicks == 3);
+    move(&fixture, 0, 60);
+    CHECK(scrolls(&fixture, scrolled, 8) == 1);
+    CHECK(scrolled[0].clicks == 1);
+    CHECK_NEAR(fixture.core.axis_y.total_movement_delta, 10, 1e-9);
+    tear_down(&fixture);
+}
+
+static void test_single_scroll()
+{
+    struct Fixture fixture;
+    set_up(&fixture, 0, 0);
+    struct FakeOutputEvent scrolled[8];
+
+    // one click stands for the whole move, the rest of it is used up as well
+    move(&fixture, 0, 350);
+    CHECK(scrolls(&fixture, scrolled, 8) == 1);
+    CHECK(scrolled[0].clicks == 1);
+    CHECK_NEAR(fixture.core.axis_y.total_movement_delta, 50, 1e-9);
+    move(&fixture, 0, -350);
+    CHECK(scrolls(&fixture, scrolled, 8) == 1);
+    CHECK(scrolled[0].clicks == -1);
+    tear_down(&fixture);
+}
+
+static void test_high_resolution_remainder()
+{
+    struct Fixture fixture;
+    set_up(&fixture, 1, 1);
+    struct FakeOutputEvent scrolled[8];
+
+    // all of the movement scrolls, in fractions of a click
+    move(&fixture, 0, 150);
+    CHECK(scrolls(&fixture, scrolled, 8) == 1);
+    CHECK_NEAR(scrolled[0].clicks, 1.5, 1e-9);
+    CHECK_NEAR(fixture.core.axis_y.total_movement_delta, 0, 1e-9);
+
+    // less than the smallest step (1/120 of a click) is held until more comes
+    move(&fixture, 0, 0.5);
+    CHECK(scrolls(&fixture, scrolled, 8) == 0);
+    move(&fixture, 0, 0.5);
+    CHECK(scrolls(&fixture, scrolled, 8) == 1);
+    CHECK_NEAR(scrolled[0].clicks, 0.01, 1e-9);
+
+    // the remainder below a step survives the end of the activation, a backlog does not
+    move(&fixture, 0, -0.5);
+    CHECK(scrolls(&fixture, scrolled, 8) == 0);
+    scroll_core_set_active(&fixture.core, 0);
+    CHECK_NEAR(fixture.core.axis_y.total_movement_delta, -0.5, 1e-9);
+    tear_down(&fixture);
+}
+
+static void test_key_release_before_first_scroll()
+{
+    struct Fixture fixture;
+    set_up(&fixture, 0, 1);
+
+    // no release for motion that doesn't scroll
+    move(&fixture, 0, 50);
+    CHECK(fixture.num_events == 1 && fixture.events[0].type == FAKE_OUTPUT_FLUSH);
+
+    // the trigger key is released before the first scroll, in the same flush
+    move(&fixture, 0, 100);
+    CHECK(fixture.num_events == 3);
+    CHECK(fixture.events[0].type == FAKE_OUTPUT_KEY_RELEASE);
+    CHECK(fixture.events[0].x_key_code == (unsigned int) RELEASE_KEY_CODE);
+    CHECK(fixture.events[1].type == FAKE_OUTPUT_SCROLL);
+    CHECK(fixture.events[2].type == FAKE_OUTPUT_FLUSH);
+
+    // only once per activation
+    move(&fixture, 0, 100);
+    CHECK(fixture.num_events == 2);
+    CHECK(fixture.events[0].type == FAKE_OUTPUT_SCROLL);
+
+    scroll_core_set_active(&fixture.core, 0);
+    scroll_core_set_active(&fixture.core, 1);
+    move(&fixture, 0, 100);
+    CHECK(fixture.num_events == 3);
+    CHECK(fixture.events[0].type == FAKE_OUTPUT_KEY_RELEASE);
+    tear_down(&fixture);
+}
+
+int main()
+{
+    log_level = LOG_WARN; // the fake backend logs every scroll
+    test_threshold();
+    test_repeated_scroll();
+    test_single_scroll();
+    test_high_resolution_remainder();
+    test_key_release_before_first_scroll();
+    return TEST_RESULT();
+}
@@ -0,0 +1,24 @@
+// USDT probes (provider mousemovetoscroll) for bpftrace, perf and SystemTap, e.g.
+//   bpftrace -e 'usdt:./MouseMoveToScroll:mousemovetoscroll:scroll { @[arg0] = count(); }'
+// an unattached probe is a nop instruction plus a note in the ELF file. Without sys/sdt.h (systemtap-sdt-dev)
+// they compile to nothing, the arguments are not evaluated.
+//  drain(events)                       the event loop handled this many events after a wakeup
+//  raw_motion(source_id, time_ms)      a motion report arrived
+//  threshold_crossed(direction, movement)  enough movement accumulated for a scroll, in counts
+//  rate_limited(direction, movement)   the scroll was held back for lack of tokens
+//  scroll(direction, hires_clicks)     a scroll is queued for output, in 1/120 clicks (< 0: up/left)
+//  activation(active)                  scrolling mode entered (1) or left (0)
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PROBE1(name, a) DTRACE_PROBE1(mousemovetoscroll, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(mousemovetoscroll, name, a, b)
+#else
+#define PROBE1(name, a) do { } while (0)
+#define PROBE2(name, a, b) do { } while (0)
+#endif
+
+#endif // PROBES_H
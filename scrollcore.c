@@ -0,0 +1,221 @@
+// motion to scroll conversion, see scrollcore.h
+
+#include "scrollcore.h"
+
+#include <math.h>
+#include "log.h"
+#include "flightrec.h"
+#include "probes.h"
+#include "accel.h"
+
+static const int HIGH_RESOLUTION_SCROLL_STEPS = 120; // smallest scroll is this fraction of a click, with a high resolution sink
+static const int32_t ACCEL_MAX_INTERVAL_MS = 50; // motion after a longer pause is measured over this long, it starts slow
+
+void scroll_core_init(struct ScrollCore* core, const struct ScrollCoreConfig* cfg, struct ScrollSink sink, struct ScrollClock clock)
+{
+    *core = (struct ScrollCore)
+    {
+        .cfg = *cfg,
+        .sink = sink,
+        .clock = clock,
+        .axis_y = { .direction = SCROLL_VERTICAL, .pacer = { .tokens = cfg->burst } },
+        .axis_x = { .direction = SCROLL_HORIZONTAL, .pacer = { .tokens = cfg->burst } },
+    };
+}
+
+void scroll_core_set_active(struct ScrollCore* core, int active)
+{
+    core->is_active = active;
+    core->scrolls_since_active = 0; // reset
+    core->axis_y.has_motion = 0; // the first motion comes after a pause
+    core->axis_x.has_motion = 0;
+    if (!active)
+        scroll_core_discard_backlog(core); // not wanted anymore
+}
+
+static void refill_scroll_tokens(struct ScrollPacer* pacer, struct ScrollCoreConfig* cfg, EventTime now)
+{
+    if (!pacer->has_refilled)
+    {
+        pacer->last_refill = now;
+        pacer->has_refilled = 1;
+        return;
+    }
+    // the clock's estimate can be a few ms behind the stamp of the previous event, that's no time passing.
+    // last_refill never goes back, the tokens of that time were handed out already
+    int32_t elapsed_ms = (int32_t) (now - pacer->last_refill);
+    if (elapsed_ms <= 0) return;
+    pacer->last_refill = now;
+    pacer->tokens += elapsed_ms * cfg->rate_limit / 1000;
+    if (pacer->tokens > cfg->burst)
+        pacer->tokens = cfg->burst;
+}
+
+// smallest scroll the sink can take, in clicks. A high resolution sink scrolls in fractions of a click.
+static double min_scroll_clicks(struct ScrollCoreConfig* cfg)
+{
+    return cfg->has_high_resolution ? 1.0 / HIGH_RESOLUTION_SCROLL_STEPS : 1;
+}
+
+// movement needed for the smallest scroll
+static double min_scroll_movement(struct ScrollCoreConfig* cfg)
+{
+    return cfg->threshold * min_scroll_clicks(cfg);
+}
+
+static void before_synthethic_scroll(struct ScrollCore* core)
+{
+    if (core->cfg.release_key_code >= 0 && core->scrolls_since_active == 0)
+        core->sink.release_key(core->sink.data, (unsigned int) core->cfg.release_key_code);
+    core->scrolls_since_active++;
+}
+
+// scrolls as much of the accumulated movement as the pacer allows
+static void scroll_paced(struct ScrollCore* core, struct ScrollAxis* axis, EventTime now)
+{
+    struct ScrollCoreConfig* cfg = &core->cfg;
+    struct ScrollPacer* pacer = &axis->pacer;
+    double threshold = cfg->threshold;
+    if (fabs(axis->total_movement_delta) <= min_scroll_movement(cfg)) return;
+    PROBE2(threshold_crossed, (int) axis->direction, (long) axis->total_movement_delta);
+
+    refill_scroll_tokens(pacer, cfg, now);
+
+    double scroll_amount; // clicks the movement is worth
+    double clicks; // clicks to send
+    if (cfg->has_high_resolution)
+    {
+        // scroll all of it, with a fraction of a click for the rest
+        scroll_amount = axis->total_movement_delta / threshold;
+        clicks = fmin(fabs(scroll_amount), pacer->tokens);
+        if (clicks < min_scroll_clicks(cfg))
+            clicks = 0;
+    }
+    else
+    {
+        scroll_amount = (int) (axis->total_movement_delta / threshold);
+        clicks = cfg->allow_repeated_scroll ? fabs(scroll_amount) : 1;
+        if (clicks > (int) pacer->tokens)
+            clicks = (int) pacer->tokens;
+    }
+    if (clicks == 0)
+    {
+        logg(LOG_DEBUG, "rate limited, holding back %g\n", axis->total_movement_delta);
+        core->stats.rate_limited_decisions++;
+        PROBE2(rate_limited, (int) axis->direction, (long) axis->total_movement_delta);
+        flight_record(core->recorder, now, FLIGHT_RATE_LIMITED, axis->direction, 0, axis->total_movement_delta, pacer->tokens);
+
+        // don't keep scrolling for ages after a wild move
+        double max_backlog = threshold * (cfg->burst + cfg->rate_limit * cfg->backlog_limit_ms / 1000);
+        if (fabs(axis->total_movement_delta) > max_backlog)
+        {
+            core->stats.discarded_backlog_clicks += (unsigned long) ((fabs(axis->total_movement_delta) - max_backlog) / threshold);
+            flight_record(core->recorder, now, FLIGHT_BACKLOG_DISCARDED, axis->direction, 0,
+                          axis->total_movement_delta - copysign(max_backlog, axis->total_movement_delta),
+                          copysign(max_backlog, axis->total_movement_delta));
+            axis->total_movement_delta = copysign(max_backlog, axis->total_movement_delta);
+        }
+        return;
+    }
+    pacer->tokens -= clicks;
+
+    before_synthethic_scroll(core);
+
+    // without repeated scroll events one click stands for the whole move, the rest of it is used up as well
+    if (cfg->allow_repeated_scroll || cfg->has_high_resolution)
+        scroll_amount = copysign(clicks, scroll_amount);
+    core->sink.scroll(core->sink.data, axis->direction, copysign(clicks, scroll_amount));
+    core->stats.scrolls++;
+
+    // adjust accumulator: reduce for distance traveled that is 'used up' by scrolling
+    // example: y mouse delta is 22, scroll threshold is 10, then scrollamount is 2 (2*10) and the (2*10) is subtracted from accumulator
+    // the (abs) new value of total_movement_delta is smaller than the threshold, unless the pacer held some back
+    axis->total_movement_delta -= scroll_amount * threshold;
+    flight_record(core->recorder, now, FLIGHT_SCROLL, axis->direction, 0, copysign(clicks, scroll_amount), axis->total_movement_delta);
+}
+
+static void check_for_scroll_trigger(struct ScrollCore* core, struct ScrollAxis* axis, double delta, EventTime now)
+{
+    logg(LOG_DEBUG, "check: dir: %s, total_movement_delta: %g, delta: %g, thres: %g\n",
+          axis->direction == SCROLL_VERTICAL ? "v" : "h",
+          axis->total_movement_delta,
+          delta,
+          core->cfg.threshold);
+
+    if (core->cfg.accel != NULL)
+    {
+        // several reports can share a ms (or a stamp be behind the previous one), or come after a pause
+        int32_t interval_ms = axis->has_motion ? (int32_t) (now - axis->last_motion) : ACCEL_MAX_INTERVAL_MS;
+        if (interval_ms > 0 || !axis->has_motion)
+            axis->last_motion = now;
+        axis->has_motion = 1;
+        if (interval_ms < 1) interval_ms = 1;
+        if (interval_ms > ACCEL_MAX_INTERVAL_MS) interval_ms = ACCEL_MAX_INTERVAL_MS;
+        delta *= accel_curve_gain(core->cfg.accel, fabs(delta) / interval_ms);
+    }
+
+    axis->total_movement_delta += delta;
+    scroll_paced(core, axis, now);
+}
+
+void scroll_core_add_motion(struct ScrollCore* core, double delta_x, double delta_y, EventTime time)
+{
+    if (!core->is_active) return;
+
+    flight_record(core->recorder, time, FLIGHT_MOTION, 0, 0, delta_x, delta_y);
+    check_for_scroll_trigger(core, &core->axis_y, delta_y, time);
+    if (core->cfg.allow_horizontal_scroll)
+        check_for_scroll_trigger(core, &core->axis_x, delta_x, time);
+}
+
+static int has_axis_backlog(struct ScrollCore* core, struct ScrollAxis* axis)
+{
+    if (axis->direction == SCROLL_HORIZONTAL && !core->cfg.allow_horizontal_scroll) return 0;
+    return fabs(axis->total_movement_delta) > min_scroll_movement(&core->cfg);
+}
+
+int scroll_core_has_backlog(struct ScrollCore* core)
+{
+    return has_axis_backlog(core, &core->axis_y) || has_axis_backlog(core, &core->axis_x);
+}
+
+// ms until the pacer has a token again
+static int next_scroll_token_delay_ms(struct ScrollPacer* pacer, struct ScrollCoreConfig* cfg, EventTime now)
+{
+    refill_scroll_tokens(pacer, cfg, now);
+    if (pacer->tokens >= min_scroll_clicks(cfg)) return 0;
+    return (int) ceil((min_scroll_clicks(cfg) - pacer->tokens) * 1000 / cfg->rate_limit);
+}
+
+int scroll_core_next_backlog_release_delay_ms(struct ScrollCore* core)
+{
+    EventTime now = core->clock.now(core->clock.data);
+
+    int delay_ms = -1;
+    if (has_axis_backlog(core, &core->axis_y))
+        delay_ms = next_scroll_token_delay_ms(&core->axis_y.pacer, &core->cfg, now);
+    if (has_axis_backlog(core, &core->axis_x))
+    {
+        int delay_x_ms = next_scroll_token_delay_ms(&core->axis_x.pacer, &core->cfg, now);
+        if (delay_ms == -1 || delay_x_ms < delay_ms)
+            delay_ms = delay_x_ms;
+    }
+    return delay_ms;
+}
+
+void scroll_core_release_backlog(struct ScrollCore* core)
+{
+    if (!core->is_active) return;
+
+    EventTime now = core->clock.now(core->clock.data);
+    scroll_paced(core, &core->axis_y, now);
+    if (core->cfg.allow_horizontal_scroll)
+        scroll_paced(core, &core->axis_x, now);
+}
+
+void scroll_core_discard_backlog(struct ScrollCore* core)
+{
+    double threshold = min_scroll_movement(&core->cfg);
+    core->axis_y.total_movement_delta = fmod(core->axis_y.total_movement_delta, threshold);
+    core->axis_x.total_movement_delta = fmod(core->axis_x.total_movement_delta, threshold);
+}
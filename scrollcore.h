@@ -0,0 +1,95 @@
+// the conversion of pointer movement into scrolling, without X.
+// movement is accumulated per axis, a threshold's worth of it is a click. A token bucket per axis paces the
+// clicks, movement held back by it (the backlog) stays in the accumulator until tokens are available again.
+// an acceleration curve, if given, scales the movement by its velocity first.
+// the caller passes in the time of each movement and provides a clock (for the backlog, when there is no
+// event at hand) and a sink that receives the scrolls.
+
+#ifndef SCROLLCORE_H
+#define SCROLLCORE_H
+
+#include <stdint.h>
+
+enum ScrollDirection
+{
+    SCROLL_HORIZONTAL = 1,
+    SCROLL_VERTICAL = 2
+};
+
+typedef uint32_t EventTime; // ms, e.g. X server time. Wraps around after ~49 days, so only compare by subtracting.
+
+struct FlightRecorder;
+struct AccelCurve;
+
+struct ScrollCoreConfig {
+    double threshold; // movement per click
+    double rate_limit; // clicks per second and axis
+    double burst; // clicks that may be sent at once after a pause
+    int backlog_limit_ms; // held back movement beyond this much scrolling time is discarded
+    int allow_horizontal_scroll;
+    int allow_repeated_scroll; // a fast move scrolls several clicks at once, else one click stands for it
+    int has_high_resolution; // the sink takes fractions of a click
+    int release_key_code; // released through the sink before the first scroll of an activation, -1: none
+    const struct AccelCurve* accel; // NULL: linear, a threshold's worth of movement is a click at any speed
+};
+
+// receives the scrolling
+struct ScrollSink {
+    void (*scroll)(void* data, enum ScrollDirection direction, double clicks); // clicks < 0: up/left
+    void (*release_key)(void* data, unsigned int key_code);
+    void* data;
+};
+
+struct ScrollClock {
+    EventTime (*now)(void* data);
+    void* data;
+};
+
+// token bucket pacing the scroll output of one axis: a click takes a token, tokens refill at
+// rate_limit up to burst
+struct ScrollPacer {
+    double tokens;
+    EventTime last_refill;
+    int has_refilled; // last_refill is set
+};
+
+struct ScrollAxis {
+    enum ScrollDirection direction;
+    double total_movement_delta; // not scrolled yet
+    EventTime last_motion; // for the velocity of the acceleration curve
+    int has_motion; // last_motion is set, since the activation
+    struct ScrollPacer pacer;
+};
+
+struct ScrollCoreStats {
+    unsigned long scrolls;
+    unsigned long rate_limited_decisions; // scroll held back for lack of tokens
+    unsigned long discarded_backlog_clicks;
+};
+
+struct ScrollCore {
+    struct ScrollCoreConfig cfg;
+    struct ScrollSink sink;
+    struct ScrollClock clock;
+    int is_active; // scrolling mode, movement is ignored without it
+    int scrolls_since_active;
+    struct ScrollAxis axis_y;
+    struct ScrollAxis axis_x;
+    struct ScrollCoreStats stats;
+    struct FlightRecorder* recorder; // the motion and the decisions on it go here, NULL: off
+};
+
+void scroll_core_init(struct ScrollCore* core, const struct ScrollCoreConfig* cfg, struct ScrollSink sink, struct ScrollClock clock);
+// leaving scrolling mode discards the backlog
+void scroll_core_set_active(struct ScrollCore* core, int active);
+// movement at time, scrolled as far as the pacers allow
+void scroll_core_add_motion(struct ScrollCore* core, double delta_x, double delta_y, EventTime time);
+
+int scroll_core_has_backlog(struct ScrollCore* core);
+// ms until one of the axes with held back movement can scroll again, -1: no backlog
+int scroll_core_next_backlog_release_delay_ms(struct ScrollCore* core);
+// scrolls held back movement, when no new motion comes in to do it
+void scroll_core_release_backlog(struct ScrollCore* core);
+void scroll_core_discard_backlog(struct ScrollCore* core);
+
+#endif // SCROLLCORE_H
@@ -0,0 +1,169 @@
+// measures the cost of the motion to scroll conversion per motion event, for synthetic motion of
+// different speeds, thresholds and output kinds. The scrolls go to a sink that only counts them.
+// each case runs again with the flight recorder on, to show what leaving it on costs, and with an acceleration
+// curve, whose cost should not depend on the curve.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "scrollcore.h"
+#include "flightrec.h"
+#include "accel.h"
+#include "log.h"
+
+#define NUM_EVENTS (1 << 20)
+#define EVENT_INTERVAL_MS 8 // a 125 Hz mouse
+
+enum Distribution
+{
+    DIST_SLOW,   // a few counts per report, a trackball rolled gently
+    DIST_FAST,   // tens of counts, a flick
+    DIST_HEAVY,  // mostly slow with rare large jumps
+    DIST_JITTER, // back and forth around the same spot
+    NUM_DISTRIBUTIONS
+};
+
+static const char* DISTRIBUTION_NAMES[] = { "slow", "fast", "heavy", "jitter" };
+static const double THRESHOLDS[] = { 10, 50, 200 };
+
+struct Sample {
+    double delta_x;
+    double delta_y;
+};
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static double random_unit()
+{
+    // xorshift64*, reproducible across runs
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (double) ((rng_state * 0x2545f4914f6cdd1dull) >> 11) / (double) (1ull << 53);
+}
+
+static double random_delta(enum Distribution distribution, int i)
+{
+    switch (distribution)
+    {
+    case DIST_SLOW: return 1 + 2 * random_unit();
+    case DIST_FAST: return 10 + 50 * random_unit();
+    case DIST_HEAVY: return fmin(1 / pow(1 - random_unit(), 1.5), 500);
+    case DIST_JITTER: return (i % 2 ? -1 : 1) * 2 * random_unit();
+    default: return 0;
+    }
+}
+
+static void fill_samples(struct Sample* samples, enum Distribution distribution)
+{
+    for (int i = 0; i < NUM_EVENTS; i++)
+    {
+        samples[i].delta_y = random_delta(distribution, i);
+        samples[i].delta_x = random_delta(distribution, i) / 4;
+    }
+}
+
+static void count_scroll(void* data, enum ScrollDirection direction, double clicks)
+{
+    (void) direction;
+    *(double*) data += fabs(clicks);
+}
+
+static void ignore_key_release(void* data, unsigned int key_code)
+{
+    (void) data; (void) key_code;
+}
+
+static EventTime fake_clock_now(void* data)
+{
+    return *(EventTime*) data;
+}
+
+static int64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static struct FlightRecorder recorder;
+static struct AccelCurve accel_curve;
+
+// returns the ns per event
+static double run_once(const struct Sample* samples, struct ScrollCore* core, const struct ScrollCoreConfig* cfg,
+                       double* clicks, struct FlightRecorder* flight_recorder)
+{
+    EventTime now = 0;
+    struct ScrollSink sink = { .scroll = count_scroll, .release_key = ignore_key_release, .data = clicks };
+    struct ScrollClock clock = { .now = fake_clock_now, .data = &now };
+    scroll_core_init(core, cfg, sink, clock);
+    core->recorder = flight_recorder;
+    scroll_core_set_active(core, 1);
+
+    int64_t start_ns = monotonic_ns();
+    for (int i = 0; i < NUM_EVENTS; i++)
+    {
+        now += EVENT_INTERVAL_MS;
+        scroll_core_add_motion(core, samples[i].delta_x, samples[i].delta_y, now);
+    }
+    return (double) (monotonic_ns() - start_ns) / NUM_EVENTS;
+}
+
+static void run(const struct Sample* samples, const char* distribution_name, double threshold, const char* mode,
+                int allow_repeated_scroll, int has_high_resolution)
+{
+    double clicks = 0;
+    double recorded_clicks = 0;
+    struct ScrollCoreConfig cfg =
+    {
+        .threshold = threshold,
+        .rate_limit = 1000.0 / 30,
+        .burst = 3,
+        .backlog_limit_ms = 500,
+        .allow_horizontal_scroll = 1,
+        .allow_repeated_scroll = allow_repeated_scroll,
+        .has_high_resolution = has_high_resolution,
+        .release_key_code = 37,
+    };
+    struct ScrollCore core;
+    double ns_per_event = run_once(samples, &core, &cfg, &clicks, NULL);
+    struct ScrollCore recorded_core;
+    double recorded_ns_per_event = run_once(samples, &recorded_core, &cfg, &recorded_clicks, &recorder);
+    double accel_clicks = 0;
+    struct ScrollCoreConfig accel_cfg = cfg;
+    accel_cfg.accel = &accel_curve;
+    struct ScrollCore accel_core;
+    double accel_ns_per_event = run_once(samples, &accel_core, &accel_cfg, &accel_clicks, NULL);
+
+    printf("%-7s %9g %-10s %10.2f %10.2f %10.2f %10lu %12.0f %12.0f %10lu\n", distribution_name, threshold, mode,
+           ns_per_event, recorded_ns_per_event, accel_ns_per_event, core.stats.scrolls, clicks, accel_clicks,
+           core.stats.rate_limited_decisions);
+}
+
+int main()
+{
+    log_level = LOG_WARN;
+    struct Sample* samples = malloc(NUM_EVENTS * sizeof(struct Sample));
+    if (flight_recorder_init(&recorder, 10) != 0)
+        return 1;
+    if (accel_curve_parse(&accel_curve, "sigmoid:4:4") != 0)
+        return 1;
+
+    printf("%d motion events per run, one every %d ms\n", NUM_EVENTS, EVENT_INTERVAL_MS);
+    printf("%-7s %9s %-10s %10s %10s %10s %10s %12s %12s %10s\n", "motion", "threshold", "output", "ns/event", "recorded",
+           "accel", "scrolls", "clicks", "accel clicks", "limited");
+    for (int distribution = 0; distribution < NUM_DISTRIBUTIONS; distribution++)
+    {
+        fill_samples(samples, (enum Distribution) distribution);
+        for (size_t t = 0; t < sizeof(THRESHOLDS) / sizeof(THRESHOLDS[0]); t++)
+        {
+            run(samples, DISTRIBUTION_NAMES[distribution], THRESHOLDS[t], "click", 0, 0);
+            run(samples, DISTRIBUTION_NAMES[distribution], THRESHOLDS[t], "repeated", 1, 0);
+            run(samples, DISTRIBUTION_NAMES[distribution], THRESHOLDS[t], "hires", 0, 1);
+        }
+    }
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,63 @@
+// live counters in shared memory, see statspage.h
+
+#include "statspage.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.h"
+
+struct StatsPage* stats_page_create(const char* path)
+{
+    // not through a symlink or into someone else's file, sized only once it is known to be ours
+    int fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd != -1 && fstat(fd, &st) == 0 && st.st_uid != geteuid())
+    {
+        close(fd);
+        fd = -1;
+        errno = EPERM;
+    }
+    if (fd == -1 || ftruncate(fd, sizeof(struct StatsPage)) == -1)
+    {
+        logg(LOG_WARN, "could not create the stats page %s: %s\n", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return NULL;
+    }
+    struct StatsPage* page = mmap(NULL, sizeof(struct StatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping stays
+    if (page == MAP_FAILED)
+    {
+        logg(LOG_WARN, "could not map the stats page %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    // left over from an earlier run: readers see it become invalid, then start over from zero
+    atomic_store_explicit(&page->magic, 0, memory_order_relaxed);
+    memset((char*) page + sizeof(page->magic), 0, sizeof(struct StatsPage) - sizeof(page->magic));
+    page->version = STATS_PAGE_VERSION;
+    page->size = sizeof(struct StatsPage);
+    page->pid = getpid();
+    atomic_store_explicit(&page->magic, STATS_PAGE_MAGIC, memory_order_release);
+    return page;
+}
+
+struct StatsPageDevice* stats_page_device(struct StatsPage* page, int source_id)
+{
+    uint32_t num_devices = atomic_load_explicit(&page->num_devices, memory_order_relaxed);
+    for (uint32_t i = 0; i < num_devices; i++)
+    {
+        if (atomic_load_explicit(&page->devices[i].source_id, memory_order_relaxed) == source_id)
+            return &page->devices[i];
+    }
+    if (num_devices == STATS_PAGE_MAX_DEVICES)
+        return &page->devices[STATS_PAGE_MAX_DEVICES - 1];
+
+    struct StatsPageDevice* device = &page->devices[num_devices];
+    atomic_store_explicit(&device->source_id, source_id, memory_order_relaxed);
+    atomic_store_explicit(&page->num_devices, num_devices + 1, memory_order_release);
+    return device;
+}
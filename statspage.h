@@ -0,0 +1,77 @@
+// live counters in a shared memory file, read by MouseMoveToScrollStats (or anything else that maps it) while the
+// program runs. Only the event loop writes them, with relaxed atomic stores, so a reader needs neither syscalls
+// nor locks and never slows the loop down; it sees each counter whole but the counters not as one snapshot.
+// the layout is host specific, read it on the same machine.
+
+#ifndef STATSPAGE_H
+#define STATSPAGE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define STATS_PAGE_PATH_FORMAT "/dev/shm/MouseMoveToScroll.%u.stats" // by uid, /dev/shm is shared by all users
+#define STATS_PAGE_PATH_SIZE 64
+#define STATS_PAGE_MAGIC 0x5441545353544d4dull // "MMTSSTAT" on a little endian host
+#define STATS_PAGE_VERSION 1
+#define STATS_PAGE_MAX_DEVICES 16
+
+enum StatsPageScroll
+{
+    STATS_SCROLL_UP,
+    STATS_SCROLL_DOWN,
+    STATS_SCROLL_LEFT,
+    STATS_SCROLL_RIGHT,
+    NUM_STATS_SCROLLS
+};
+
+struct StatsPageDevice {
+    _Atomic int32_t source_id; // XInput2 source device, or the index of an evdev device
+    _Atomic uint64_t events; // raw motion received
+    _Atomic uint64_t ignored_events; // not scrolled: duplicate, not a selected device, or not in scrolling mode
+};
+
+struct StatsPage {
+    // set once at startup, the magic last
+    _Atomic uint64_t magic;
+    uint32_t version;
+    uint32_t size; // sizeof(struct StatsPage)
+    int32_t pid;
+
+    // the counters, on cache lines of their own
+    _Atomic uint64_t events __attribute__((aligned(64))); // raw motion received, all devices
+    _Atomic uint64_t ignored_events;
+    _Atomic uint64_t warps;
+    _Atomic uint64_t activations; // scrolling mode entered
+    _Atomic uint64_t scrolls[NUM_STATS_SCROLLS]; // by enum StatsPageScroll
+    _Atomic uint64_t rate_limited_decisions; // scrolls held back by the rate limit (-l, -b)
+    _Atomic uint64_t discarded_backlog_clicks; // held back for too long and dropped
+    _Atomic uint64_t dropped_scrolls; // emitter queue full
+    _Atomic uint32_t num_devices;
+    struct StatsPageDevice devices[STATS_PAGE_MAX_DEVICES] __attribute__((aligned(64)));
+};
+
+// by the single writer
+static inline void stats_page_add(_Atomic uint64_t* counter, uint64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline void stats_page_set(_Atomic uint64_t* counter, uint64_t value)
+{
+    atomic_store_explicit(counter, value, memory_order_relaxed);
+}
+
+// the page of this user's program
+static inline void stats_page_default_path(char path[STATS_PAGE_PATH_SIZE])
+{
+    snprintf(path, STATS_PAGE_PATH_SIZE, STATS_PAGE_PATH_FORMAT, (unsigned) geteuid());
+}
+
+// creates (or takes over) the page at path. Returns NULL if that fails
+struct StatsPage* stats_page_create(const char* path);
+// the device's counters, added on first use. The last slot is shared once all are taken
+struct StatsPageDevice* stats_page_device(struct StatsPage* page, int source_id);
+
+#endif // STATSPAGE_H
@@ -0,0 +1,91 @@
+// prints the live counters of a running MouseMoveToScroll from its stats page, once or every interval
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "statspage.h"
+
+#define LOAD(counter) ((unsigned long long) atomic_load_explicit(&(counter), memory_order_relaxed))
+
+static void print_page(struct StatsPage* p)
+{
+    printf("pid %d\n", p->pid);
+    printf("events %llu ignored %llu\n", LOAD(p->events), LOAD(p->ignored_events));
+    printf("activations %llu warps %llu\n", LOAD(p->activations), LOAD(p->warps));
+    printf("scrolls up %llu down %llu left %llu right %llu\n", LOAD(p->scrolls[STATS_SCROLL_UP]),
+           LOAD(p->scrolls[STATS_SCROLL_DOWN]), LOAD(p->scrolls[STATS_SCROLL_LEFT]), LOAD(p->scrolls[STATS_SCROLL_RIGHT]));
+    printf("rate limited decisions %llu discarded backlog clicks %llu dropped scrolls %llu\n",
+           LOAD(p->rate_limited_decisions), LOAD(p->discarded_backlog_clicks), LOAD(p->dropped_scrolls));
+
+    uint32_t num_devices = atomic_load_explicit(&p->num_devices, memory_order_acquire);
+    for (uint32_t i = 0; i < num_devices && i < STATS_PAGE_MAX_DEVICES; i++)
+    {
+        printf("device %d events %llu ignored %llu\n", atomic_load_explicit(&p->devices[i].source_id, memory_order_relaxed),
+               LOAD(p->devices[i].events), LOAD(p->devices[i].ignored_events));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char default_path[STATS_PAGE_PATH_SIZE];
+    stats_page_default_path(default_path);
+    const char* path = default_path;
+    int interval_ms = 0;
+    int c;
+    while ((c = getopt(argc, argv, "i:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-i interval ms] [stats page, default %s]\n", argv[0], default_path);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        perror(path);
+        return 1;
+    }
+    if (st.st_size < (off_t) sizeof(struct StatsPage))
+    {
+        fprintf(stderr, "%s is not a stats page of this version of MouseMoveToScroll\n", path);
+        return 1;
+    }
+    // shared, so the program's stores show up as they happen
+    struct StatsPage* page = mmap(NULL, sizeof(struct StatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED)
+    {
+        perror(path);
+        return 1;
+    }
+
+    while (1)
+    {
+        // checked every time, the program may have been restarted
+        if (atomic_load_explicit(&page->magic, memory_order_acquire) != STATS_PAGE_MAGIC
+                || page->version != STATS_PAGE_VERSION || page->size != sizeof(struct StatsPage))
+        {
+            fprintf(stderr, "%s is not a stats page of this version of MouseMoveToScroll\n", path);
+            return 1;
+        }
+        print_page(page);
+        if (interval_ms <= 0) return 0;
+
+        printf("\n");
+        fflush(stdout);
+        usleep((useconds_t) interval_ms * 1000);
+    }
+}
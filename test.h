@@ -0,0 +1,35 @@
+// checks for the tests, each test is a program that returns nonzero if a check failed
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <math.h>
+
+static int test_failures = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do \
+    { \
+        double actual_value = (actual); \
+        double expected_value = (expected); \
+        if (!(fabs(actual_value - expected_value) <= (tolerance))) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s is %g, expected %g\n", __FILE__, __LINE__, #actual, actual_value, expected_value); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+#endif // TEST_H
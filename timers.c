@@ -0,0 +1,111 @@
+// timers, see timers.h
+
+#include "timers.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+int64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int timer_set_init(struct TimerSet* set)
+{
+    memset(set, 0, sizeof(*set));
+    set->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    return set->fd == -1 ? -1 : 0;
+}
+
+// arm the timerfd for the earliest deadline plus slack, only touching it when that changed
+static void rearm(struct TimerSet* set)
+{
+    int64_t fires_at_ns = 0;
+    for (int i = 0; i < set->num_timers; i++)
+    {
+        int64_t latest_ns = set->timers[i]->deadline_ns + set->timers[i]->slack_ns;
+        if (fires_at_ns == 0 || latest_ns < fires_at_ns)
+            fires_at_ns = latest_ns;
+    }
+    if (fires_at_ns == set->fires_at_ns) return;
+    set->fires_at_ns = fires_at_ns;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec)); // all zero disarms
+    if (fires_at_ns != 0)
+    {
+        spec.it_value.tv_sec = fires_at_ns / 1000000000;
+        spec.it_value.tv_nsec = fires_at_ns % 1000000000;
+    }
+    if (timerfd_settime(set->fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1)
+        fprintf(stderr, "failed to arm timer: %s\n", strerror(errno));
+}
+
+static void remove_timer(struct TimerSet* set, struct Timer* timer)
+{
+    for (int i = 0; i < set->num_timers; i++)
+    {
+        if (set->timers[i] == timer)
+        {
+            set->timers[i] = set->timers[--set->num_timers];
+            break;
+        }
+    }
+    timer->is_armed = 0;
+}
+
+void timer_start(struct TimerSet* set, struct Timer* timer, int64_t delay_ns, int64_t slack_ns)
+{
+    if (!timer->is_armed)
+    {
+        if (set->num_timers == MAX_TIMERS)
+        {
+            fprintf(stderr, "too many timers\n");
+            return;
+        }
+        set->timers[set->num_timers++] = timer;
+        timer->is_armed = 1;
+    }
+    timer->deadline_ns = monotonic_ns() + delay_ns;
+    timer->slack_ns = slack_ns;
+    rearm(set);
+}
+
+void timer_cancel(struct TimerSet* set, struct Timer* timer)
+{
+    if (!timer->is_armed) return;
+    remove_timer(set, timer);
+    rearm(set);
+}
+
+int timer_set_run_expired(struct TimerSet* set)
+{
+    uint64_t expirations;
+    if (read(set->fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+        fprintf(stderr, "failed to read timer: %s\n", strerror(errno));
+    set->fires_at_ns = -1; // the timerfd is spent, make rearm() set it again
+
+    // collect first, callbacks may start or cancel timers
+    struct Timer* due[MAX_TIMERS];
+    int num_due = 0;
+    int64_t now_ns = monotonic_ns();
+    for (int i = 0; i < set->num_timers; i++)
+    {
+        if (set->timers[i]->deadline_ns <= now_ns)
+            due[num_due++] = set->timers[i];
+    }
+    for (int i = 0; i < num_due; i++)
+        remove_timer(set, due[i]);
+
+    for (int i = 0; i < num_due; i++)
+        due[i]->callback(due[i]->data);
+
+    rearm(set);
+    return num_due;
+}
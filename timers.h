@@ -0,0 +1,36 @@
+// one-shot timers multiplexed onto a single timerfd, for the epoll based event loop.
+// a timer may fire up to its slack late. The timerfd is armed for the earliest deadline plus slack,
+// and everything due by then runs in the same wakeup, so timers due around the same time share it.
+
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <stdint.h>
+
+#define MAX_TIMERS 8
+
+struct Timer {
+    void (*callback)(void* data);
+    void* data;
+    int64_t deadline_ns; // CLOCK_MONOTONIC
+    int64_t slack_ns;
+    int is_armed;
+};
+
+struct TimerSet {
+    int fd; // timerfd, readable when timers are due. Pass to timer_set_run_expired() then.
+    struct Timer* timers[MAX_TIMERS]; // armed timers
+    int num_timers;
+    int64_t fires_at_ns; // what fd is armed for, 0: disarmed
+};
+
+// returns 0 on success
+int timer_set_init(struct TimerSet* set);
+// (re)starts the timer to fire in delay_ns, at most slack_ns later
+void timer_start(struct TimerSet* set, struct Timer* timer, int64_t delay_ns, int64_t slack_ns);
+void timer_cancel(struct TimerSet* set, struct Timer* timer);
+// runs the callbacks of all due timers, returns how many
+int timer_set_run_expired(struct TimerSet* set);
+int64_t monotonic_ns(void);
+
+#endif // TIMERS_H
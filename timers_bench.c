@@ -0,0 +1,97 @@
+// measures the timer multiplexing of timers.c: how many timerfd wake-ups periodic timers of different periods
+// take with and without slack (timers due around the same time share a wake-up), and how late the callbacks run
+// after their deadline.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include "timers.h"
+
+#define RUN_NS 2000000000LL
+#define MAX_SAMPLES 4096
+
+// a periodic timer, restarted by its callback
+struct PeriodicTimer {
+    struct Timer timer;
+    struct TimerSet* set;
+    int64_t period_ns;
+    int64_t slack_ns;
+    unsigned long runs;
+};
+
+// like the program's: backlog release, kinetic ticks, motion stop, stats report
+static const int64_t PERIODS_NS[] = { 8000000, 16000000, 50000000, 1000000000 };
+#define NUM_PERIODIC_TIMERS (int) (sizeof(PERIODS_NS) / sizeof(PERIODS_NS[0]))
+
+static int64_t late_ns[MAX_SAMPLES];
+static int num_late;
+
+static void on_periodic_timer(void* data)
+{
+    struct PeriodicTimer* periodic = (struct PeriodicTimer*) data;
+    if (num_late < MAX_SAMPLES)
+        late_ns[num_late++] = monotonic_ns() - periodic->timer.deadline_ns;
+    periodic->runs++;
+    timer_start(periodic->set, &periodic->timer, periodic->period_ns, periodic->slack_ns);
+}
+
+static int compare_int64(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+// slack as a fraction of each timer's period
+static int run(double slack_fraction)
+{
+    struct TimerSet set;
+    if (timer_set_init(&set) != 0)
+    {
+        perror("timerfd");
+        return -1;
+    }
+    struct PeriodicTimer periodic[NUM_PERIODIC_TIMERS];
+    for (int i = 0; i < NUM_PERIODIC_TIMERS; i++)
+    {
+        periodic[i] = (struct PeriodicTimer)
+        {
+            .timer = { .callback = on_periodic_timer, .data = &periodic[i] },
+            .set = &set,
+            .period_ns = PERIODS_NS[i],
+            .slack_ns = (int64_t) (PERIODS_NS[i] * slack_fraction),
+        };
+        timer_start(&set, &periodic[i].timer, periodic[i].period_ns, periodic[i].slack_ns);
+    }
+
+    num_late = 0;
+    unsigned long wakeups = 0;
+    unsigned long callbacks = 0;
+    int64_t end_ns = monotonic_ns() + RUN_NS;
+    while (monotonic_ns() < end_ns)
+    {
+        struct pollfd fd = { .fd = set.fd, .events = POLLIN };
+        if (poll(&fd, 1, -1) != 1) continue;
+        wakeups++;
+        callbacks += (unsigned long) timer_set_run_expired(&set);
+    }
+
+    qsort(late_ns, (size_t) num_late, sizeof(int64_t), compare_int64);
+    printf("%8.0f%% %10lu %10lu %12.2f %10.1f %10.1f %10.1f\n", slack_fraction * 100, callbacks, wakeups,
+           wakeups ? (double) callbacks / wakeups : 0.0, late_ns[num_late / 2] / 1000.0,
+           late_ns[num_late * 99 / 100] / 1000.0, late_ns[num_late - 1] / 1000.0);
+    return 0;
+}
+
+int main()
+{
+    printf("%d periodic timers (8, 16, 50, 1000 ms) for %.0f s per run, slack a fraction of the period, lateness of the callbacks\n",
+           NUM_PERIODIC_TIMERS, RUN_NS / 1e9);
+    printf("%9s %10s %10s %12s %10s %10s %10s\n", "slack", "callbacks", "wakeups", "per wakeup", "p50 us", "p99 us", "max us");
+    static const double SLACK_FRACTIONS[] = { 0, 0.05, 0.25, 0.5 };
+    for (size_t i = 0; i < sizeof(SLACK_FRACTIONS) / sizeof(SLACK_FRACTIONS[0]); i++)
+    {
+        if (run(SLACK_FRACTIONS[i]) != 0)
+            return 1;
+    }
+    return 0;
+}
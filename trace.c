@@ -0,0 +1,199 @@
+// input traces, see trace.h
+
+#include "trace.h"
+
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.h"
+
+#define TRACE_MOTION_SCALE 256.0 // fixed point motion, raw values can have fractions
+#define TRACE_WRITE_BUFFER_SIZE (64 * 1024)
+#define TRACE_COUNTS_PER_MM_SCALE 1000.0 // XI2 resolutions are whole counts per metre
+
+static size_t put_varint(unsigned char* out, uint64_t value)
+{
+    size_t len = 0;
+    while (value >= 0x80)
+    {
+        out[len++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (unsigned char) value;
+    return len;
+}
+
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+int trace_writer_open(struct TraceWriter* writer, const char* path)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL)
+    {
+        logg(LOG_ERROR, "could not open trace %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, TRACE_WRITE_BUFFER_SIZE);
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, writer->file);
+    return 0;
+}
+
+void trace_write(struct TraceWriter* writer, const struct TraceEvent* event)
+{
+    unsigned char record[64 + TRACE_MAX_DEVICE_NAME_LEN];
+    size_t len = 0;
+    record[len++] = (unsigned char) event->type;
+    len += put_varint(record + len, (EventTime) (event->time - writer->last_time));
+    writer->last_time = event->time;
+
+    switch (event->type)
+    {
+    case TRACE_MOTION:
+        len += put_varint(record + len, (uint64_t) event->device_id);
+        len += put_varint(record + len, (uint64_t) event->source_id);
+        len += put_varint(record + len, zigzag(llround(event->delta_x * TRACE_MOTION_SCALE)));
+        len += put_varint(record + len, zigzag(llround(event->delta_y * TRACE_MOTION_SCALE)));
+        break;
+    case TRACE_KEY_PRESS:
+    case TRACE_KEY_RELEASE:
+        len += put_varint(record + len, (uint64_t) event->key_code);
+        len += put_varint(record + len, (uint64_t) event->modifiers);
+        record[len++] = (unsigned char) (event->is_repeat != 0);
+        break;
+    case TRACE_DEVICE:
+    {
+        len += put_varint(record + len, (uint64_t) event->device_id);
+        len += put_varint(record + len, (uint64_t) llround(event->counts_per_mm[0] * TRACE_COUNTS_PER_MM_SCALE));
+        len += put_varint(record + len, (uint64_t) llround(event->counts_per_mm[1] * TRACE_COUNTS_PER_MM_SCALE));
+        size_t name_len = strnlen(event->device_name, TRACE_MAX_DEVICE_NAME_LEN - 1);
+        len += put_varint(record + len, name_len);
+        memcpy(record + len, event->device_name, name_len);
+        len += name_len;
+        break;
+    }
+    }
+    fwrite(record, 1, len, writer->file);
+    writer->num_events++;
+}
+
+void trace_writer_close(struct TraceWriter* writer)
+{
+    if (writer->file == NULL) return;
+    fclose(writer->file);
+    writer->file = NULL;
+}
+
+int trace_reader_open(struct TraceReader* reader, const char* path)
+{
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        logg(LOG_ERROR, "could not open trace %s: %s\n", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return -1;
+    }
+    if (st.st_size < TRACE_MAGIC_LEN)
+    {
+        logg(LOG_ERROR, "%s is not a trace\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays
+    if (data == MAP_FAILED)
+    {
+        logg(LOG_ERROR, "could not map trace %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+    reader->data = data;
+    reader->size = (size_t) st.st_size;
+    if (memcmp(reader->data, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0)
+    {
+        logg(LOG_ERROR, "%s is not a trace\n", path);
+        trace_reader_close(reader);
+        return -1;
+    }
+    reader->pos = TRACE_MAGIC_LEN;
+    return 0;
+}
+
+// returns 0 if the trace ends within the varint
+static int get_varint(struct TraceReader* reader, uint64_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && reader->pos < reader->size; shift += 7)
+    {
+        unsigned char byte = reader->data[reader->pos++];
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return 1;
+    }
+    return 0;
+}
+
+int trace_read(struct TraceReader* reader, struct TraceEvent* event)
+{
+    if (reader->pos == reader->size) return 0;
+
+    memset(event, 0, sizeof(*event));
+    event->type = (enum TraceEventType) reader->data[reader->pos++];
+    uint64_t time_delta, a, b, c, d;
+    if (!get_varint(reader, &time_delta)) return -1;
+    event->time = reader->last_time = (EventTime) (reader->last_time + time_delta);
+
+    switch (event->type)
+    {
+    case TRACE_MOTION:
+        if (!get_varint(reader, &a) || !get_varint(reader, &b) || !get_varint(reader, &c) || !get_varint(reader, &d))
+            return -1;
+        event->device_id = (int) a;
+        event->source_id = (int) b;
+        event->delta_x = unzigzag(c) / TRACE_MOTION_SCALE;
+        event->delta_y = unzigzag(d) / TRACE_MOTION_SCALE;
+        return 1;
+    case TRACE_KEY_PRESS:
+    case TRACE_KEY_RELEASE:
+        if (!get_varint(reader, &a) || !get_varint(reader, &b) || reader->pos == reader->size)
+            return -1;
+        event->key_code = (int) a;
+        event->modifiers = (int) b;
+        event->is_repeat = reader->data[reader->pos++];
+        return 1;
+    case TRACE_DEVICE:
+        if (!get_varint(reader, &a) || !get_varint(reader, &b) || !get_varint(reader, &c) || !get_varint(reader, &d))
+            return -1;
+        if (d >= TRACE_MAX_DEVICE_NAME_LEN || d > reader->size - reader->pos)
+            return -1;
+        event->device_id = (int) a;
+        event->counts_per_mm[0] = b / TRACE_COUNTS_PER_MM_SCALE;
+        event->counts_per_mm[1] = c / TRACE_COUNTS_PER_MM_SCALE;
+        memcpy(event->device_name, reader->data + reader->pos, d);
+        reader->pos += d;
+        return 1;
+    }
+    return -1;
+}
+
+void trace_reader_close(struct TraceReader* reader)
+{
+    if (reader->data != NULL)
+        munmap((void*) reader->data, reader->size);
+    reader->data = NULL;
+}
@@ -0,0 +1,69 @@
+// input traces: what the event loop saw (raw motion, trigger keys), recorded with --record and fed through the
+// conversion again with --replay. Each device's resolution and name come before its first motion, so the replay
+// scales its motion (-m) and picks its profile (--profile) the same.
+// the file is the magic followed by records. A record is its type byte, the time since the previous record
+// and the type's fields, all as LEB128 varints (signed ones zigzag encoded, motion in 1/256 counts).
+// traces are read through mmap, so even long captures load instantly.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "scrollcore.h"
+
+#define TRACE_MAGIC "MMTSTRC1"
+#define TRACE_MAGIC_LEN 8
+
+enum TraceEventType
+{
+    TRACE_MOTION = 1,
+    TRACE_KEY_PRESS = 2,
+    TRACE_KEY_RELEASE = 3,
+    TRACE_DEVICE = 4
+};
+
+#define TRACE_MAX_DEVICE_NAME_LEN 128
+
+struct TraceEvent {
+    enum TraceEventType type;
+    EventTime time;
+    // motion
+    int device_id;
+    int source_id;
+    double delta_x;
+    double delta_y;
+    // keys
+    int key_code;
+    int modifiers;
+    int is_repeat;
+    // device, device_id is its id
+    double counts_per_mm[2]; // x and y, 0 if it doesn't report its resolution
+    char device_name[TRACE_MAX_DEVICE_NAME_LEN];
+};
+
+struct TraceWriter {
+    FILE* file;
+    EventTime last_time;
+    unsigned long num_events;
+};
+
+struct TraceReader {
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    EventTime last_time;
+};
+
+// returns 0 on success
+int trace_writer_open(struct TraceWriter* writer, const char* path);
+void trace_write(struct TraceWriter* writer, const struct TraceEvent* event);
+void trace_writer_close(struct TraceWriter* writer);
+
+// returns 0 on success
+int trace_reader_open(struct TraceReader* reader, const char* path);
+// returns 1 if an event was read, 0 at the end of the trace, -1 if it is malformed
+int trace_read(struct TraceReader* reader, struct TraceEvent* event);
+void trace_reader_close(struct TraceReader* reader);
+
+#endif // TRACE_H